@@ -8,10 +8,38 @@
 #define _async_kmer_counter_
 
 #include "kmer-counter.hpp"
+#include "kmer-counting-session.hpp"
 #include "fasta-parser.hpp"
+#include "mapped-fasta-parser.hpp"
+#include "kmer-sorter.hpp"
+#include "disk-partitioned-counter.hpp"
+#include "count-min-sketch.hpp"
+#include "hyperloglog.hpp"
+#include "bloom-filter.hpp"
+#include "kmer-spectrum.hpp"
+#include "space-saving.hpp"
 #include <threadpool.hpp>
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
+
+// Records at least this long are split into chunks and counted on several threads at once
+#define PARALLEL_RECORD_THRESHOLD (((size_t) 1) << 22)
+#define PARALLEL_CHUNK_SIZE (((size_t) 1) << 20)
+
+// Mapped files are split into byte ranges of at least this size, one per thread, which are parsed concurrently
+#define PARSE_RANGE_MIN_SIZE (((size_t) 1) << 20)
+
+// Records with fewer than 1 / SHORT_RECORD_RATIO as many symbols as there are k-mers are counted
+// into a sorted list of the k-mers which occur, rather than a dense vector that must be zeroed
+#define SHORT_RECORD_RATIO 16
+
+// Number of counts tallied (or searched for the most frequent k-mers) by each task
+#define SPECTRUM_CHUNK_SIZE (((size_t) 1) << 20)
 
 class AsyncKmerCounter {
 
@@ -39,6 +67,7 @@ public:
    * @param in: Stream to read fasta-formatted sequences from
    * @param out: Stream to output k-mer counts to
    * @param sequential: If true, k-mers will be counted in order, if false, multi-threading will be used
+   * @throws std::runtime_error: If counting out of core and a bucket file can't be written or read
    */
   void count(std::istream& in, std::ostream& out, bool sequential, bool block=true);
 
@@ -65,9 +94,11 @@ public:
   /**
    * Public Method: count_fasta_file
    * -------------------------------
-   * Counts the fasta file and prints the output to the provided outfile
+   * Counts the fasta file and prints the output to the provided outfile. Regular files counted record by
+   * record are mapped into memory (see MappedFastaParser) rather than read through a stream.
    * @param fastaFile : Path to fasta file to count k-mers in
    * @param out: Output stream to output k-mer counts to
+   * @throws std::runtime_error: If counting out of core and a bucket file can't be written or read
    */
   void count_fasta_file(const std::string &fastaFile, std::ostream &out, bool sequential, bool block=true);
 
@@ -77,6 +108,8 @@ public:
    * Count fasta files in a stream
    * @param directory: Directory to read fasta files from
    * @param out: Output stream to output k-mer counts to
+   * @throws std::runtime_error: If counting out of core and a bucket file can't be written or read. Files
+   * counted on the pool without blocking report such errors to standard error instead.
    */
   void count_directory(const std::string &directory, std::ostream &out, bool sequential, bool block=true);
 
@@ -106,6 +139,195 @@ public:
    */
   void set_kmer_length(unsigned int kmer_length) { kmer_counter.set_kmer_length(kmer_length); }
 
+  /**
+   * Public method: set_min_kmer_length
+   * ----------------------------------
+   * Set the shortest k-mer length to count. Every k-mer length from this up to the k-mer length is
+   * counted in a single pass over the input, and each record is output as a block of lines, one per
+   * k-mer length, whose headers are suffixed with " k=<length>".
+   * @param min_kmer_length: The shortest k-mer length, or zero to count only the k-mer length
+   */
+  void set_min_kmer_length(unsigned int min_kmer_length) { kmer_counter.set_min_kmer_length(min_kmer_length); }
+
+  /**
+   * Public method: set_spaced_seed
+   * ------------------------------
+   * Set a spaced seed such as "1101011" whose '1' positions select the symbols of each k-mer. The
+   * k-mer length becomes the number of '1's, and counts are output as for contiguous k-mers of that length.
+   * @param seed: String of '1' (care) and '0' (don't care) positions, or empty for contiguous k-mers
+   */
+  void set_spaced_seed(const std::string& seed) { kmer_counter.set_spaced_seed(seed); }
+
+  /**
+   * Public method: set_canonical
+   * ----------------------------
+   * Set whether k-mers are counted together with their reverse complements. In canonical mode only
+   * the counts of canonical k-mers (those no greater than their reverse complement) are output, in
+   * lexicographic order.
+   * @param canonical: True to count canonical k-mers
+   */
+  void set_canonical(bool canonical) { kmer_counter.set_canonical(canonical); }
+
+  /**
+   * Public method: set_partitioned
+   * ------------------------------
+   * Set whether k-mer indices are radix-partitioned into cache-sized buckets before being counted into
+   * large dense vectors of counts (e.g. k = 14 for DNA). The output is the same either way.
+   * @param partitioned: True to partition k-mer indices before counting
+   */
+  void set_partitioned(bool partitioned) { kmer_counter.set_partitioned(partitioned); }
+
+  /**
+   * Public method: set_sorting
+   * --------------------------
+   * Set whether k-mers are counted by sorting (see KmerSorter) rather than into dense vectors or hash
+   * tables. The codes of each record (or each file when summing) are collected in buffers no larger
+   * than the memory budget, radix sorted on the thread pool, and output sparsely as "k-mer:count" pairs.
+   * @param sorting: True to count k-mers by sorting
+   */
+  void set_sorting(bool sorting) { this->sorting = sorting; }
+
+  /**
+   * Public method: set_disk_buckets
+   * -------------------------------
+   * Set the number of bucket files to partition k-mers into on disk for out-of-core counting (see
+   * DiskPartitionedCounter), or zero to count in memory. Out-of-core counting sums the counts of every
+   * record in each file, and outputs them sparsely as "k-mer:count" pairs.
+   * @param disk_buckets: The number of bucket files
+   */
+  void set_disk_buckets(size_t disk_buckets) { this->disk_buckets = disk_buckets; }
+
+  /**
+   * Public method: set_temp_directory
+   * ---------------------------------
+   * Set the directory in which bucket files are created for out-of-core counting
+   * @param temp_directory: The directory, or empty for the system's temporary directory
+   */
+  void set_temp_directory(const std::string& temp_directory) { this->temp_directory = temp_directory; }
+
+  /**
+   * Public method: set_sketch
+   * -------------------------
+   * Set whether k-mers are counted approximately in a fixed-size Count-Min sketch (see CountMinSketch)
+   * rather than exactly. Every k-mer of each file is added to one sketch, which is written to the output
+   * in its serialized format once the file has been counted.
+   * @param sketch: "countmin", "conservative" for conservative update, or empty to count exactly
+   * @param width: Number of counters in each row of the sketch
+   * @param depth: Number of rows in the sketch
+   */
+  void set_sketch(const std::string& sketch, size_t width, unsigned int depth) {
+    this->sketch = sketch;
+    sketch_width = width;
+    sketch_depth = depth;
+  }
+
+  /**
+   * Public method: set_spectrum
+   * ---------------------------
+   * Set whether the k-mer spectrum is output instead of the k-mer counts. Each line of output is then
+   * the header followed by "count:k-mers" pairs, giving how many k-mers occur once, twice and so on,
+   * tallied from the counts on the thread pool.
+   * @param spectrum: True to output the k-mer spectrum
+   */
+  void set_spectrum(bool spectrum) { this->spectrum = spectrum; }
+
+  /**
+   * Public method: set_top_kmers
+   * ----------------------------
+   * Set whether only the most frequent k-mers are output, as "k-mer:count" pairs in decreasing order of
+   * count. They are selected from the counts on the thread pool, or, with Space-Saving counters, k-mers
+   * are not counted exactly at all: each record (or file, when summing) is streamed through a SpaceSaving
+   * summary of bounded size, whose counts may overestimate.
+   * @param top_kmers: The number of k-mers to output per record or file, or zero to output every count
+   * @param space_saving: The number of Space-Saving counters, or zero to select from exact counts
+   */
+  void set_top_kmers(size_t top_kmers, size_t space_saving) {
+    this->top_kmers = top_kmers;
+    this->space_saving = space_saving;
+  }
+
+  /**
+   * Public method: set_bloom_filter
+   * -------------------------------
+   * Set whether k-mers which occur only once are kept out of the sparse count table with a Bloom filter
+   * (see BloomFilter), in the style of BFCounter. A k-mer enters the table the second time the filter
+   * sees it, so only k-mers occurring at least twice are output, with counts which may exceed the true
+   * count by one for false positives of the filter. An exact second pass over the input fixes the counts
+   * up, which requires input that can be read twice (i.e. not standard input). Filtered counting sums
+   * the counts of every record in each file, and outputs them sparsely as "k-mer:count" pairs.
+   * @param bytes: Size of the filter, or zero to count without one
+   * @param exact: True to recount the k-mers in the table exactly in a second pass
+   */
+  void set_bloom_filter(size_t bytes, bool exact) {
+    bloom_bytes = bytes;
+    bloom_exact = exact;
+  }
+
+  /**
+   * Public method: set_cardinality
+   * ------------------------------
+   * Set whether only the number of distinct k-mers is estimated, with a HyperLogLog sketch, rather than
+   * k-mers being counted. One line "header, <distinct k-mers>" is output per record, or per file when
+   * summing. The sketches of everything counted are also merged into one (see cardinality_sketch).
+   * @param precision: Precision of the sketches (see HyperLogLog), or zero to count k-mers
+   */
+  void set_cardinality(unsigned int precision) {
+    cardinality_precision = precision;
+    all_kmers = HyperLogLog(precision);
+  }
+
+  /**
+   * Public method: cardinality_sketch
+   * ---------------------------------
+   * @return: The HyperLogLog sketch of every k-mer in every record counted so far in cardinality mode
+   */
+  HyperLogLog cardinality_sketch() const {
+    std::lock_guard<std::mutex> lock(all_kmers_lock);
+    return all_kmers;
+  }
+
+  /**
+   * Public method: supports_canonical
+   * ---------------------------------
+   * @return: True if canonical counting is possible with the current symbols and k-mer length
+   */
+  bool supports_canonical() const { return kmer_counter.supports_canonical(); }
+
+  /**
+   * Public method: set_memory_budget
+   * --------------------------------
+   * Set the largest dense vector of counts, in bytes, that may be allocated for one record. Beyond
+   * this, k-mers are counted sparsely and output as "k-mer:count" pairs.
+   * @param bytes: The memory budget of one dense count vector
+   */
+  void set_memory_budget(uint64_t bytes) { kmer_counter.set_memory_budget(bytes); }
+
+  /**
+   * Public method: set_report_skipped
+   * ---------------------------------
+   * Set whether the number of invalid symbols (e.g. N) skipped in each record is output. If so,
+   * " skipped=<bases>" is appended to the header of each record's line of counts.
+   * @param report_skipped: True to report skipped bases
+   */
+  void set_report_skipped(bool report_skipped) { this->report_skipped = report_skipped; }
+
+  /**
+   * Public method: validate
+   * -----------------------
+   * Checks that k-mers can be counted with the current settings
+   * @throws std::invalid_argument: Describing the problem with the settings
+   */
+  void validate() const;
+
+  /**
+   * Public method: set_counter_bits
+   * -------------------------------
+   * Set the width of each counter in dense vectors of counts. Narrow counters saturate and spill
+   * into a side table, so the output is exact regardless of the width.
+   * @param counter_bits: 8, 16, 32 or 64
+   */
+  void set_counter_bits(unsigned int counter_bits) { this->counter_bits = counter_bits; }
+
   /**
    * Destructor
    * ----------
@@ -117,5 +339,95 @@ private:
   KmerCounter kmer_counter;
   boost::threadpool::pool& pool;
   bool sum_files; // True if all k-mer counts in each file are be summed together
+  unsigned int counter_bits = 64; // Width of each counter in dense vectors of counts
+  bool report_skipped = false; // True to append the number of skipped bases to each header
+  bool sorting = false;        // True to count k-mers with KmerSorter
+  size_t disk_buckets = 0;     // Number of bucket files for out-of-core counting, zero to count in memory
+  std::string temp_directory;  // Where bucket files are created
+  std::string sketch;          // Kind of Count-Min sketch to count into, empty to count exactly
+  size_t sketch_width = DEFAULT_SKETCH_WIDTH;
+  unsigned int sketch_depth = DEFAULT_SKETCH_DEPTH;
+  unsigned int cardinality_precision = 0; // Precision of HyperLogLog sketches, zero to count k-mers
+  HyperLogLog all_kmers;                  // Union of the sketches of every record
+  mutable std::mutex all_kmers_lock;
+  bool spectrum = false;                  // True to output the k-mer spectrum rather than the counts
+  size_t top_kmers = 0;                   // Number of most frequent k-mers to output, zero for every count
+  size_t space_saving = 0;                // Number of Space-Saving counters, zero to count exactly
+  size_t bloom_bytes = 0;                 // Size of the singleton filter, zero to count without one
+  bool bloom_exact = false;               // True to recount filtered k-mers exactly in a second pass
+
+  bool is_dense() const { return kmer_counter.is_dense(counter_bits / 8); }
+  bool counts_records_alone() const {
+    return !kmer_counter.counting_range() && cardinality_precision == 0 && sketch.empty() && space_saving == 0 &&
+           disk_buckets == 0 && !sorting && bloom_bytes == 0 && !(sum_files && !is_dense());
+  }
+  bool is_short_record(size_t length) const {
+    return length * SHORT_RECORD_RATIO < kmer_counter.get_vector_size();
+  }
+
+  // Progress of one record being counted in chunks by several threads (see count_chunked)
+  struct ChunkedCount {
+    const char* sequence;
+    size_t length;
+    size_t num_chunks;
+    long* counts;                      // Sum of the counts of every chunk, guarded by lock
+    std::atomic<size_t> next_chunk;    // Next chunk to be claimed
+    std::mutex lock;
+    std::condition_variable merged;    // Notified as each thread adds its counts into counts
+    size_t num_merged = 0;             // Number of chunks whose counts have been added into counts
+    uint64_t skipped_bases = 0;
+  };
+
+  uint64_t count_dense(const std::string& sequence, long counts[]);
+  uint64_t count_chunked(const std::string& sequence, long counts[], size_t num_helpers);
+  void count_chunks(ChunkedCount& state);
+  std::vector<std::pair<kmer_code_t, long>> count_short(const std::string& sequence);
+  void write_short_counts(std::ostream& out, const std::string& header,
+                          const std::vector<std::pair<kmer_code_t, long>>& counts);
+  void write_zeros(std::ostream& out, uint64_t begin, uint64_t end);
+
+  void count_mapped(const std::string& fasta_file, std::ostream& out, bool sequential, bool block);
+  void count_record(std::ostream& out, const FastaRecordView& record, bool parallel);
+  template<typename Counter> void count_narrow_record(std::ostream& out, const std::string& header,
+                                                     const std::string& sequence);
+  template<typename Counter> void count_narrow_sequential(std::istream &in, std::ostream &out);
+  template<typename Counter> void count_narrow_async(std::istream &in, std::ostream &out, bool block);
+  void count_range_sequential(std::istream &in, std::ostream &out);
+  void count_range_async(std::istream &in, std::ostream &out, bool block);
+  void count_range(const std::string& sequence, long counts[]);
+  void write_range_counts(std::ostream& out, const std::string& header, const long counts[]);
+  void count_partitioned(std::istream &in, std::ostream &out, bool parallel);
+  void count_sketch(std::istream &in, std::ostream &out, bool parallel);
+  void count_cardinality(std::istream &in, std::ostream &out, bool parallel, bool block);
+  void count_filtered(std::istream &in, std::ostream &out, bool parallel);
+  void count_heavy_hitters(std::istream &in, std::ostream &out, bool parallel, bool block);
+  std::string count_pass(std::istream &in, bool parallel, const std::function<void(kmer_code_t)>& visit);
+  void count_sorted_sequential(std::istream &in, std::ostream &out);
+  void count_sorted_async(std::istream &in, std::ostream &out, bool block);
+  std::unique_ptr<KmerSorter> make_sorter(size_t max_codes);
+  void count_sparse_sequential(std::istream &in, std::ostream &out);
+  void count_sparse_async(std::istream &in, std::ostream &out, bool block);
+  template<typename Counts> void write_counts(std::ostream& out, const std::string& header, const Counts& counts,
+                                              unsigned int kmer_length);
+  template<typename Counts> void write_dense_counts(std::ostream& out, const std::string& header, const Counts& counts,
+                                                    unsigned int kmer_length);
+  template<typename Counts> std::string summary_line(const std::string& header, const Counts& counts,
+                                                     unsigned int kmer_length);
+  static void write_lines(std::ostream& out, const std::string& lines);
+  std::vector<std::pair<kmer_code_t, long>> count_sparse(const std::string& sequence);
+  size_t table_capacity(uint64_t max_kmers) const;
+  static uint64_t stream_size(std::istream& in);
+  static std::vector<std::pair<kmer_code_t, long>> sorted_kmers(const ConcurrentKmerTable& table);
+  static std::vector<std::pair<kmer_code_t, long>> sorted_kmers(const SparseKmerCounts& counts);
+  static std::vector<std::pair<kmer_code_t, long>> sorted_kmers(KmerSorter& sorter);
+  std::string record_header(const std::string& header) const;
+  std::string record_header(const std::string& header, uint64_t skipped_bases) const;
+  void write_sparse_counts(std::ostream& out, const std::string& header,
+                           const std::vector<std::pair<kmer_code_t, long>>& counts);
+  template<typename CountAt> KmerSpectrum spectrum_of(uint64_t size, CountAt count_at);
+  template<typename KmerAt> std::vector<std::pair<kmer_code_t, long>> top_of(uint64_t size, KmerAt kmer_at);
+  void write_kmers(std::ostream& out, const std::string& header,
+                   const std::vector<std::pair<kmer_code_t, long>>& counts);
+  static void write_spectrum(std::ostream& out, const std::string& header, const KmerSpectrum& spectrum);
 };
 #endif
@@ -8,6 +8,7 @@
 #define _BatchProcessor_H
 
 #include <threadpool.hpp>
+#include <cstdint>
 #include <functional>
 #include <string>
 #include <fstream>
@@ -64,6 +65,17 @@ public:
    */
   void wait();
 
+  /**
+   * Public Method: reduce_max
+   * -------------------------
+   * Combines a buffer of bytes from every rank element-wise by maximum, leaving the result in the buffer
+   * of the head node. Every rank must call this, after wait.
+   * @param data: The buffer, of the same length on every rank
+   * @param length: Number of bytes in the buffer
+   * @return: True on the head node, which holds the result
+   */
+  bool reduce_max(uint8_t data[], size_t length);
+
   /**
    * Public method: init_logger
    * --------------------------
@@ -0,0 +1,71 @@
+/**
+ * File: bloom-filter.hpp
+ * ----------------------
+ * Presents the BloomFilter class, a concurrent blocked Bloom filter of k-mer codes used to keep k-mers
+ * which occur only once (mostly sequencing errors) out of the sparse count table, in the style of
+ * BFCounter. The filter is partitioned into 64-bit words: each k-mer sets BLOOM_HASHES bits within a
+ * single word chosen by its hash, so testing and inserting is one atomic fetch-or. Any number of threads
+ * may insert at once, and of two threads inserting the same k-mer, one always finds it already present,
+ * which would not hold if its bits were spread over several words.
+ *
+ * Usage:
+ *
+ * BloomFilter filter(64 << 20);
+ * if (filter.insert(code)) table.increment(code); // only once the k-mer has been seen before
+ */
+
+#ifndef _bloom_filter_
+#define _bloom_filter_
+
+#include "mix64.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+// Number of bits set in the filter by each k-mer
+#define BLOOM_HASHES 4
+
+class BloomFilter {
+
+public:
+
+  /**
+   * Constructor
+   * -----------
+   * Creates an empty filter
+   * @param bytes: Size of the filter (rounded up to a power of two number of 64-bit words)
+   */
+  explicit BloomFilter(size_t bytes);
+
+  BloomFilter(const BloomFilter&) = delete;
+  BloomFilter& operator=(const BloomFilter&) = delete;
+
+  /**
+   * Public Method: insert
+   * ---------------------
+   * Adds a k-mer to the filter. Safe to call from many threads at once.
+   * @param code: The 64-bit code of the k-mer
+   * @return: True if the k-mer may have been added before, false if it certainly had not been
+   */
+  bool insert(uint64_t code) {
+    uint64_t h = mix64(code); // The low bits choose the word and the high bits the bits within it
+    uint64_t mask = 0;
+    for (unsigned int i = 0; i < BLOOM_HASHES; i++) mask |= ((uint64_t) 1) << ((h >> (64 - 6 * (i + 1))) & 63);
+    uint64_t bits = words[(size_t) h & word_mask].fetch_or(mask, std::memory_order_relaxed);
+    return (bits & mask) == mask;
+  }
+
+  /**
+   * Public Method: get_size
+   * -----------------------
+   * @return: Size of the filter in bytes
+   */
+  size_t get_size() const { return (word_mask + 1) * sizeof(uint64_t); }
+
+private:
+  size_t word_mask;                               // Number of words, a power of two, less one
+  std::unique_ptr<std::atomic<uint64_t>[]> words;
+};
+
+#endif
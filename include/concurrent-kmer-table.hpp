@@ -0,0 +1,144 @@
+/**
+ * File: concurrent-kmer-table.hpp
+ * -------------------------------
+ * Presents the ConcurrentKmerTable class, a lock-free open-addressing hash table of k-mer counts
+ * keyed by 64-bit k-mer code. Any number of threads may call increment concurrently: keys are
+ * claimed with a compare-and-swap and counts are updated with fetch-add.
+ *
+ * The table grows online without stopping the threads that use it. When a generation of the
+ * table passes its load factor, the first thread to notice links a generation of twice the
+ * capacity after it with a compare-and-swap, and insertions move on to the new generation. The
+ * keys of the full generation are then moved into the new one cooperatively: every thread which
+ * finds the full generation claims slices of MIGRATION_SLICE slots in turn and moves their keys
+ * before carrying on. A slot is moved by sealing its key, or its count with an exchange, so that
+ * threads still using the old slot find it sealed and follow on to the new generation, where counts
+ * of the same k-mer are added together. Once every slice has been moved, the generation is retired
+ * and no longer searched, so lookups touch a single generation once growth has finished.
+ *
+ * Usage:
+ *
+ * ConcurrentKmerTable table;
+ * pool.schedule([&] () { table.increment(code); });  // from any thread
+ * pool.wait();
+ * for (auto& kmer : table.collect()) { ... }         // (code, count) pairs in order of code
+ */
+
+#ifndef _concurrent_kmer_table_
+#define _concurrent_kmer_table_
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#define CONCURRENT_TABLE_INITIAL_CAPACITY (1 << 16)
+#define MIGRATION_SLICE 4096 // Slots of a full generation moved by a thread at a time
+
+class ConcurrentKmerTable {
+
+public:
+
+  /**
+   * Constructor
+   * -----------
+   * Creates an empty table
+   * @param initial_capacity: Number of slots in the first generation (rounded up to a power of two)
+   */
+  explicit ConcurrentKmerTable(size_t initial_capacity = CONCURRENT_TABLE_INITIAL_CAPACITY);
+
+  ConcurrentKmerTable(const ConcurrentKmerTable&) = delete;
+  ConcurrentKmerTable& operator=(const ConcurrentKmerTable&) = delete;
+
+  /**
+   * Public Method: increment
+   * ------------------------
+   * Adds to the count of a k-mer. Safe to call from many threads at once.
+   * @param code: The 64-bit code of the k-mer
+   * @param amount: The amount to add to its count
+   */
+  void increment(uint64_t code, long amount = 1);
+
+  /**
+   * Public Method: increment_existing
+   * ---------------------------------
+   * Adds to the count of a k-mer only if it is already in the table. Safe to call from many threads at
+   * once, and alongside increment.
+   * @param code: The 64-bit code of the k-mer
+   * @param amount: The amount to add to its count
+   * @return: True if the k-mer was in the table
+   */
+  bool increment_existing(uint64_t code, long amount = 1);
+
+  /**
+   * Public Method: reset_counts
+   * ---------------------------
+   * Sets the count of every k-mer in the table to zero, keeping the k-mers themselves. Must not be
+   * called while other threads are incrementing.
+   */
+  void reset_counts();
+
+  /**
+   * Public Method: collect
+   * ----------------------
+   * Gives the count of every k-mer in the table, summed over the generations not yet retired. Must
+   * not be called while other threads are incrementing.
+   * @return: (code, count) pairs sorted by code
+   */
+  std::vector<std::pair<uint64_t, long>> collect() const;
+
+  /**
+   * Public Method: capacity
+   * -----------------------
+   * @return: Total number of slots over the generations not yet retired
+   */
+  size_t capacity() const;
+
+  /**
+   * Public Method: generations
+   * --------------------------
+   * @return: The number of generations not yet retired, which is one once growth has finished
+   */
+  size_t generations() const;
+
+  /**
+   * Destructor
+   * ----------
+   * Frees every generation of the table, retired or not
+   */
+  ~ConcurrentKmerTable();
+
+private:
+
+  struct Slot {
+    std::atomic<uint64_t> key;
+    std::atomic<long> count;
+  };
+
+  struct Generation {
+    explicit Generation(size_t capacity);
+    const size_t capacity;             // Power of two
+    const size_t max_used;             // Grow once this many slots are claimed
+    const size_t num_slices;           // Slices of MIGRATION_SLICE slots moved one at a time
+    Slot* slots;
+    std::atomic<size_t> used;
+    std::atomic<Generation*> next;     // The generation this one is moved into once full
+    std::atomic<size_t> next_slice;    // Next slice for a thread to move
+    std::atomic<size_t> slices_moved;  // Number of slices moved, all of them once retired
+  };
+
+  Generation* first;                 // First generation, the head of the list, kept until destroyed
+  std::atomic<Generation*> oldest;   // Oldest generation not yet retired
+  std::atomic<Generation*> current;  // Newest known generation, where insertions begin
+  std::atomic<long> marker_counts[2];  // Counts of the k-mers whose codes are the slot markers
+  std::atomic<bool> has_marker[2];     // True once the k-mer whose code is each slot marker is added
+
+  void add(Generation* generation, uint64_t code, long amount);
+  static Slot* claim(Generation* generation, uint64_t code);
+  static Slot* find(Generation* generation, uint64_t code);
+  Generation* grow(Generation* full);
+  void move_slice(Generation* full, size_t slice);
+  void retire();
+};
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ * File: count-min-sketch.hpp
+ * --------------------------
+ * Presents the CountMinSketch class, a fixed-size sketch of approximate k-mer counts. The sketch is
+ * depth rows of width counters. Each k-mer increments one counter per row, chosen by a hash of its
+ * code for that row, and its count is estimated as the least of those counters. Estimates never fall
+ * below the true count, and exceed it by more than e / width of the total count with probability
+ * at most e^-depth, so memory (4 * width * depth bytes) may be traded for accuracy explicitly and
+ * does not grow with the input.
+ *
+ * With conservative update, only the counters of a k-mer that are at its current estimate are
+ * incremented, which keeps the same guarantee with much smaller overestimates.
+ *
+ * Serialized format (native byte order): the 8 bytes "KMERCMS1", the uint64_t width, the uint32_t
+ * depth, uint32_t flags (1 for conservative update), the uint64_t total count, then the depth rows
+ * of width uint32_t counters.
+ *
+ * Usage:
+ *
+ * CountMinSketch sketch(1 << 20, 4, true);
+ * kmer_counter.for_each_kmer(sequence, [&sketch] (kmer_code_t code) { sketch.add((uint64_t) code); });
+ * sketch.save(out);
+ * auto loaded = CountMinSketch::load(in);
+ * uint32_t estimate = loaded->estimate(kmer_counter.kmer_index("ACGT"));
+ */
+
+#ifndef _count_min_sketch_
+#define _count_min_sketch_
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+
+#define DEFAULT_SKETCH_WIDTH (((size_t) 1) << 22)
+#define DEFAULT_SKETCH_DEPTH 4
+
+class CountMinSketch {
+
+public:
+
+  /**
+   * Constructor
+   * -----------
+   * Creates a sketch with every counter zero
+   * @param width: Number of counters in each row (rounded up to a power of two)
+   * @param depth: Number of rows, each with an independent hash
+   * @param conservative: True to increment only the counters at a k-mer's current estimate
+   */
+  CountMinSketch(size_t width, unsigned int depth, bool conservative);
+
+  CountMinSketch(const CountMinSketch&) = delete;
+  CountMinSketch& operator=(const CountMinSketch&) = delete;
+
+  /**
+   * Public Method: add
+   * ------------------
+   * Adds one occurrence of a k-mer. Safe to call from many threads at once. Counters saturate
+   * rather than wrap around.
+   * @param code: The 64-bit code of the k-mer
+   */
+  void add(uint64_t code);
+
+  /**
+   * Public Method: estimate
+   * -----------------------
+   * @param code: The 64-bit code of a k-mer
+   * @return: An estimate of the k-mer's count, no less than its true count
+   */
+  uint32_t estimate(uint64_t code) const;
+
+  /**
+   * Public Method: merge
+   * --------------------
+   * Adds the counters of another sketch with the same width and depth into this one, so that this
+   * sketch summarizes both inputs. Must not be called while other threads are adding to either sketch.
+   * @param other: The sketch to merge in
+   * @throws std::invalid_argument: If the sketches have different dimensions
+   */
+  void merge(const CountMinSketch& other);
+
+  /**
+   * Public Method: save
+   * -------------------
+   * Writes the sketch in its serialized format
+   * @param out: Stream to write the sketch to
+   */
+  void save(std::ostream& out) const;
+
+  /**
+   * Static Method: load
+   * -------------------
+   * Reads a sketch written by save
+   * @param in: Stream to read the sketch from
+   * @return: The sketch
+   * @throws std::runtime_error: If the stream does not hold a serialized sketch
+   */
+  static std::unique_ptr<CountMinSketch> load(std::istream& in);
+
+  size_t get_width() const { return width; }
+  unsigned int get_depth() const { return depth; }
+  bool is_conservative() const { return conservative; }
+
+  /**
+   * Public Method: get_total
+   * ------------------------
+   * @return: The number of k-mer occurrences added
+   */
+  uint64_t get_total() const { return total.load(std::memory_order_relaxed); }
+
+private:
+  size_t width;                                   // Power of two
+  unsigned int depth;
+  bool conservative;
+  std::unique_ptr<std::atomic<uint32_t>[]> counters; // depth rows of width counters
+  std::atomic<uint64_t> total;
+
+  size_t slot(uint64_t hash, unsigned int row) const;
+};
+
+#endif
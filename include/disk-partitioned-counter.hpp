@@ -0,0 +1,104 @@
+/**
+ * File: disk-partitioned-counter.hpp
+ * ----------------------------------
+ * Presents the DiskPartitionedCounter class, which counts the k-mers of data sets larger than memory
+ * in the style of KMC. Sequences are split into super-k-mers by minimizer (see
+ * KmerCounter::for_each_super_kmer), and each super-k-mer is spilled to one of N bucket files on
+ * local disk chosen by the hash of its minimizer. Every occurrence of a k-mer has the same minimizer,
+ * so the buckets hold disjoint sets of k-mers and each may be counted on its own on the thread pool
+ * with the in-memory engine. Counting a bucket takes memory in proportion to the bucket rather than to
+ * the whole k-mer space. The sorted counts of each bucket are written back to disk, and merged in
+ * lexicographic order as they are collected, so counting every bucket is done before any output is.
+ *
+ * Usage:
+ *
+ * DiskPartitionedCounter counter(kmer_counter, pool, 64, "/tmp");
+ * counter.add(sequence);                                        // for each record
+ * counter.count_buckets(true);
+ * counter.collect([&] (uint64_t code, long count) { ... });     // in order of code
+ */
+
+#ifndef _disk_partitioned_counter_
+#define _disk_partitioned_counter_
+
+#include "kmer-counter.hpp"
+#include <threadpool.hpp>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define DEFAULT_DISK_BUCKETS 64
+
+class DiskPartitionedCounter {
+
+public:
+
+  /**
+   * Constructor
+   * -----------
+   * Creates a counter with empty bucket files in a new directory. The k-mer counter must have 64-bit
+   * k-mer indices (see KmerCounter::has_64_bit_index).
+   * @param kmer_counter: Counter used to split sequences into super-k-mers and to count each bucket
+   * @param pool: Thread pool to count buckets on
+   * @param num_buckets: The number of bucket files
+   * @param directory: Directory in which to create the bucket files, or empty for the system's
+   * temporary directory
+   * @throws std::runtime_error: If the bucket files can't be created
+   */
+  DiskPartitionedCounter(KmerCounter& kmer_counter, boost::threadpool::pool& pool,
+                         size_t num_buckets, const std::string& directory);
+
+  DiskPartitionedCounter(const DiskPartitionedCounter&) = delete;
+  DiskPartitionedCounter& operator=(const DiskPartitionedCounter&) = delete;
+
+  /**
+   * Public Method: add
+   * ------------------
+   * Splits a sequence into super-k-mers and spills each to its bucket file
+   * @param sequence: Sequence of symbols to count k-mers in
+   * @throws std::runtime_error: If a bucket file can't be written (e.g. the disk is full)
+   */
+  void add(const std::string& sequence);
+
+  /**
+   * Public Method: count_buckets
+   * ----------------------------
+   * Counts every bucket once every sequence has been added. Only one bucket's counts are in memory per
+   * thread at a time.
+   * @param parallel: True to count buckets on the pool, false to count them one at a time on this thread
+   * @throws std::runtime_error: If a bucket file can't be written, read back, or replaced by its counts
+   */
+  void count_buckets(bool parallel);
+
+  /**
+   * Public Method: collect
+   * ----------------------
+   * Merges the counts of every bucket from disk once they have been counted, calling visit with the count
+   * of every k-mer added, in order of code
+   * @param visit: Callable taking the uint64_t code and the long count of each k-mer
+   * @throws std::runtime_error: If the counts of a bucket can't be read back
+   */
+  void collect(const std::function<void(uint64_t, long)>& visit);
+
+  /**
+   * Destructor
+   * ----------
+   * Removes the bucket files and their directory
+   */
+  ~DiskPartitionedCounter();
+
+private:
+  KmerCounter& kmer_counter;
+  boost::threadpool::pool& pool;
+  std::string directory;                               // Created by this object, removed on destruction
+  std::vector<std::unique_ptr<std::ofstream>> buckets; // Super-k-mers, each a uint32_t length then symbols
+
+  std::string bucket_path(size_t bucket) const;
+  std::string counts_path(size_t bucket) const;
+  void count_bucket(size_t bucket);
+};
+
+#endif
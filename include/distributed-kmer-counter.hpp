@@ -40,8 +40,29 @@ private:
   bool debug;
 
   size_t kmer_length;
+  size_t min_kmer_length; // Zero unless counting a range of k-mer lengths
+  std::string spaced_seed;
   std::string symbols;
   bool sum_files = false;
+  bool canonical = false;
+  bool partitioned = false;
+  bool sorting = false;
+  size_t disk_buckets = 0;
+  std::string temp_directory;
+  std::string sketch;
+  size_t sketch_width = DEFAULT_SKETCH_WIDTH;
+  unsigned int sketch_depth = DEFAULT_SKETCH_DEPTH;
+  bool cardinality = false;
+  unsigned int hll_precision = DEFAULT_HLL_PRECISION;
+  std::string hll_output; // Defaults to the output file with ".hll" appended
+  size_t bloom_filter = 0; // MiB
+  bool bloom_exact = false;
+  bool spectrum = false;
+  size_t top_kmers = 0;
+  size_t space_saving = 0;
+  bool report_skipped = false;
+  size_t memory_budget; // MiB
+  unsigned int counter_bits;
 
   std::string input_directory;
   boost::regex file_regex;
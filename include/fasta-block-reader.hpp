@@ -0,0 +1,108 @@
+/**
+ * File: fasta-block-reader.hpp
+ * ----------------------------
+ * Presents the FastaBlockReader class, which reads a stream or file descriptor that can't be mapped
+ * (standard input, a pipe from a decompressor) in large blocks on a thread of its own. Blocks are read
+ * into a ring of FASTA_BLOCK_RING buffers, so that reading runs ahead of parsing and a producer on the
+ * other end of a pipe is kept busy. Parsers scan the blocks in place for newlines and headers with
+ * memchr (vectorized in glibc), and a record spanning the end of a block is simply continued in the
+ * next, so no record is copied more than once.
+ *
+ * Usage:
+ *
+ * FastaBlockReader reader(&cin);
+ * const char* block;
+ * while (size_t length = reader.next_block(block)) { ... } // block is valid until the next call
+ */
+
+#ifndef _fasta_block_reader_
+#define _fasta_block_reader_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Size of each block read, and number of blocks which may be read ahead of the parser
+#define FASTA_BLOCK_SIZE (((size_t) 4) << 20)
+#define FASTA_BLOCK_RING 4
+
+class FastaBlockReader {
+
+public:
+
+  /**
+   * Constructor
+   * -----------
+   * Starts reading a stream. Standard input is read straight from its file descriptor.
+   * @param in: The stream to read, which nothing else may read from until the reader is destroyed
+   */
+  explicit FastaBlockReader(std::istream* in);
+
+  /**
+   * Constructor
+   * -----------
+   * Starts reading a file descriptor, which is not closed by the reader
+   * @param fd: The file descriptor to read
+   */
+  explicit FastaBlockReader(int fd);
+
+  /**
+   * Destructor
+   * ----------
+   * Waits for a read in progress to finish, then stops reading
+   */
+  ~FastaBlockReader();
+
+  FastaBlockReader(const FastaBlockReader&) = delete;
+  FastaBlockReader& operator=(const FastaBlockReader&) = delete;
+
+  /**
+   * Public Method: next_block
+   * -------------------------
+   * Hands back the last block given and waits for the next to be read
+   * @param block: Set to point at the next block, which remains valid until the next call
+   * @return: The number of bytes in the block, or zero at the end of the input
+   */
+  size_t next_block(const char*& block);
+
+  /**
+   * Public Method: find_header
+   * --------------------------
+   * @param block: A block of input
+   * @param position: Position in the block to search from, which is not itself looked at
+   * @param length: Number of bytes in the block
+   * @return: Position of the first '>' after position which follows a newline, or length if there is none
+   */
+  static size_t find_header(const char* block, size_t position, size_t length) {
+    while (position + 1 < length) {
+      const char* mark = (const char*) memchr(block + position + 1, '>', length - position - 1);
+      if (mark == nullptr) break;
+      position = (size_t) (mark - block);
+      if (block[position - 1] == '\n') return position;
+    }
+    return length;
+  }
+
+private:
+  std::istream* in = nullptr;
+  int fd = -1;
+  std::vector<std::vector<char>> buffers;  // The ring of blocks
+  std::vector<size_t> lengths;             // Number of bytes read into each block
+  size_t num_read = 0;                     // Number of blocks read so far, guarded by lock
+  size_t num_taken = 0;                    // Number of blocks handed to the parser so far
+  size_t num_released = 0;                 // Number of blocks the parser is done with
+  bool finished = false;                   // True once the end of the input has been read
+  bool stopping = false;                   // True once the reader is being destroyed
+  std::mutex lock;
+  std::condition_variable changed;         // Notified as blocks are read and released
+  std::thread reader;
+
+  void read_blocks();
+  size_t read_block(char* block);
+};
+
+#endif
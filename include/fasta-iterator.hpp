@@ -2,7 +2,8 @@
  * File: fasta-iterator.h
  * ----------------------
  * Presents the implementation of the FastaIterator class. This class is used to parse fasta records out
- * of a fasta file or stream by iterating through them easily in a for loop.
+ * of a fasta file or stream by iterating through them easily in a for loop. Records are parsed out of
+ * the blocks of a FastaBlockReader in place, each sequence being copied once into the record.
  *
  * Usage example:
  *
@@ -20,10 +21,10 @@
 #ifndef _fasta_iterator_
 #define _fasta_iterator_
 
+#include "fasta-block-reader.hpp"
 #include <string>
 #include <fstream>
 #include <memory>
-#include <sstream>
 
 class FastaIterator {
 
@@ -32,10 +33,10 @@ public:
   /**
    * Constructor: FastaIterator
    * --------------------------
-   * Creates a FastaIterator object that is prepared to parse fasta records from the passed stream.
-   * @param in : Stream from which to read and parse fasta records
+   * Creates a FastaIterator object that is prepared to parse fasta records from the passed reader.
+   * @param reader : Reader of the stream from which to parse fasta records, or null for the end
    */
-  explicit FastaIterator(std::istream* in);
+  explicit FastaIterator(std::shared_ptr<FastaBlockReader> reader);
 
   /**
    * Dereference operator*
@@ -43,7 +44,7 @@ public:
    * For getting the contents that the iterator is pointing to
    * @return: A copy of a shared_ptr to a record pair
    */
-  std::shared_ptr<std::pair<std::string, std::ostringstream>> operator* ();
+  std::shared_ptr<std::pair<std::string, std::string>> operator* ();
 
   /**
    * Dereference operator->
@@ -51,7 +52,7 @@ public:
    * For getting the contents that the iterator is pointing to
    * @return: A copy of a shared_ptr to a record pair
    */
-  std::shared_ptr<std::pair<std::string, std::ostringstream>> operator-> ();
+  std::shared_ptr<std::pair<std::string, std::string>> operator-> ();
 
   /**
    * Prefix operator
@@ -88,11 +89,15 @@ public:
   bool operator != (const FastaIterator& other);
 
 private:
-  std::istream* in; // The stream to read fasta records from
-  bool have_next_header; // True is nextHeader contains the next header
+  std::shared_ptr<FastaBlockReader> reader; // The reader of the stream to read fasta records from
+  const char* block = nullptr; // The block being parsed
+  size_t block_length = 0;
+  size_t position = 0;    // Position of the next character to parse in the block
+  bool line_start = true; // True if the next character begins a line
   std::string nextHeader; // The next header in the records
-  std::shared_ptr<std::pair<std::string, std::ostringstream>> record; // Pointer to the parsed content
+  std::shared_ptr<std::pair<std::string, std::string>> record; // Pointer to the parsed content
 
+  bool fill();
   bool find_next_header();
 };
 
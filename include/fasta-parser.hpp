@@ -21,13 +21,19 @@
  *
  * parser.parseHeader("> Fasta header");
  *
+ * Records too long to hold in memory can instead be streamed, their sequences passed on in fragments:
+ *
+ * parser.stream([&] (const string& header) { ... }, [&] (const char* fragment, size_t length) { ... },
+ *               [&] () { ... });
  */
 
 #ifndef _fasta_parser_
 #define _fasta_parser_
 
 #include "fasta-iterator.hpp"
+#include "fasta-block-reader.hpp"
 #include <cstring>
+#include <functional>
 #include <iostream>
 #include <memory>
 
@@ -51,6 +57,14 @@ public:
    */
   explicit FastaParser(const std::string& fasta_file);
 
+  /**
+   * Constructor: FastaParser
+   * ------------------------
+   * For creating a fasta parser for parsing from a file descriptor such as a pipe
+   * @param fd: File descriptor from which to read fasta formatted records, which is not closed
+   */
+  explicit FastaParser(int fd);
+
   /**
    * Public method: begin
    * --------------------
@@ -77,8 +91,26 @@ public:
    */
   std::string parse_header(const std::string &header);
 
+  /**
+   * Public method: stream
+   * ---------------------
+   * Reads the records of the stream a block at a time without collecting their sequences, so that
+   * records of any length are read in constant memory. Records are parsed as by the iterator.
+   * @param begin_record: Called with the header of each record before any of its sequence
+   * @param feed: Called with each fragment (const char*, size_t) of the sequence of the record. Fragments
+   * may span several lines, newlines included, and are only valid until feed returns.
+   * @param end_record: Called once the whole sequence of the record has been fed
+   */
+  void stream(const std::function<void(const std::string&)>& begin_record,
+              const std::function<void(const char*, size_t)>& feed,
+              const std::function<void()>& end_record);
+
 private:
   std::istream* fasta_stream = nullptr;
+  int fasta_fd = -1;
+  std::shared_ptr<FastaBlockReader> reader; // Reads the stream or file descriptor once parsing begins
   FastaIterator endit;
+
+  std::shared_ptr<FastaBlockReader> get_reader();
 };
 #endif
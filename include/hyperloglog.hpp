@@ -0,0 +1,115 @@
+/**
+ * File: hyperloglog.hpp
+ * ---------------------
+ * Presents the HyperLogLog class, a sketch estimating the number of distinct k-mers in a sequence
+ * without counting them. Each k-mer code is hashed; the top precision bits of the hash choose one of
+ * 2^precision registers, which keeps the longest run of leading zeros seen in the remaining bits. The
+ * harmonic mean of the registers estimates the number of distinct codes with a relative standard
+ * error of about 1.04 / sqrt(2^precision), in 2^precision bytes whatever the size of the input.
+ *
+ * Sketches of the same precision merge by taking the larger of each pair of registers, so records
+ * counted on different threads (or files counted on different MPI ranks) may be sketched separately
+ * and combined into the sketch of their union.
+ *
+ * Serialized format: the 8 bytes "KMERHLL1", the uint32_t precision (native byte order), then the
+ * 2^precision one-byte registers.
+ *
+ * Usage:
+ *
+ * HyperLogLog sketch(14);
+ * kmer_counter.for_each_kmer(sequence, [&sketch] (kmer_code_t code) { sketch.add((uint64_t) code); });
+ * uint64_t distinct = sketch.estimate();
+ */
+
+#ifndef _hyperloglog_
+#define _hyperloglog_
+
+#include "mix64.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#define HLL_MIN_PRECISION 4
+#define HLL_MAX_PRECISION 18
+#define DEFAULT_HLL_PRECISION 14
+
+class HyperLogLog {
+
+public:
+
+  /**
+   * Constructor
+   * -----------
+   * Creates an empty sketch
+   * @param precision: Number of hash bits choosing a register, from HLL_MIN_PRECISION to
+   * HLL_MAX_PRECISION (clamped to that range)
+   */
+  explicit HyperLogLog(unsigned int precision = DEFAULT_HLL_PRECISION);
+
+  /**
+   * Public Method: add
+   * ------------------
+   * Adds a k-mer to the set the sketch summarizes. Not safe to call from several threads at once.
+   * @param code: The 64-bit code of the k-mer
+   */
+  void add(uint64_t code) {
+    uint64_t h = mix64(code);
+    size_t index = (size_t) (h >> (64 - precision));
+    uint64_t rest = (h << precision) | (((uint64_t) 1) << (precision - 1)); // Caps the rank
+    uint8_t rank = (uint8_t) (__builtin_clzll(rest) + 1);
+    if (rank > registers[index]) registers[index] = rank;
+  }
+
+  /**
+   * Public Method: estimate
+   * -----------------------
+   * @return: The estimated number of distinct k-mers added. Small sets are counted exactly by the
+   * number of empty registers (linear counting).
+   */
+  uint64_t estimate() const;
+
+  /**
+   * Public Method: merge
+   * --------------------
+   * Makes this the sketch of the union of its set and another's
+   * @param other: A sketch of the same precision
+   * @throws std::invalid_argument: If the sketches have different precisions
+   */
+  void merge(const HyperLogLog& other);
+
+  /**
+   * Public Method: save
+   * -------------------
+   * Writes the sketch in its serialized format
+   * @param out: Stream to write the sketch to
+   */
+  void save(std::ostream& out) const;
+
+  /**
+   * Static Method: load
+   * -------------------
+   * Reads a sketch written by save
+   * @param in: Stream to read the sketch from
+   * @return: The sketch
+   * @throws std::runtime_error: If the stream does not hold a serialized sketch
+   */
+  static HyperLogLog load(std::istream& in);
+
+  unsigned int get_precision() const { return precision; }
+
+  /**
+   * Public Method: data
+   * -------------------
+   * @return: The registers, get_size() bytes which may be combined element-wise by maximum with the
+   * registers of another sketch of the same precision (e.g. by an MPI reduction) to merge them
+   */
+  uint8_t* data() { return registers.data(); }
+  size_t get_size() const { return registers.size(); }
+
+private:
+  unsigned int precision;
+  std::vector<uint8_t> registers;
+};
+
+#endif
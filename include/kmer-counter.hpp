@@ -4,13 +4,54 @@
  * Presents the interface of a thread-safe KmerCounter. Objects of this class
  * will count k-mers in sequences for arbitrary symbol sets and k-mer lengths
  * in a thread-safe manner.
+ *
+ * K-mers are identified by their lexicographic index, a 64-bit kmer_code_t (or 128-bit when
+ * built with KMER_WIDE_INDEX). Counts are stored densely in an array of get_vector_size()
+ * longs when that array fits in the memory budget, and sparsely in a SparseKmerCounts
+ * map otherwise.
+ *
+ * Runs of invalid symbols (e.g. N) are stepped over using the translator's bitmask of invalid
+ * positions, and each engine is run once per maximal run of valid symbols, so the rolling index
+ * is only restarted once per run.
  */
 
 #ifndef _kmer_counter_
 #define _kmer_counter_
 
+#include "sequence-translator.hpp"
+#include "packed-kmer-engine.hpp"
+#include "spaced-seed-engine.hpp"
+#include "kmer-kernels.hpp"
+#include "concurrent-kmer-table.hpp"
+#include "saturating-counts.hpp"
+#include "partitioned-counter.hpp"
+#include "mix64.hpp"
+#include <cstdint>
 #include <string>
-#include <map>
+#include <vector>
+#include <unordered_map>
+
+// Default limit on the size of a dense k-mer count vector (4 GiB)
+#define DEFAULT_MEMORY_BUDGET (((uint64_t) 4) << 30)
+
+// Length of the m-mers from which the minimizer of each k-mer is chosen (see for_each_super_kmer)
+#define MINIMIZER_LENGTH 9
+
+#if defined(KMER_WIDE_INDEX) && defined(__SIZEOF_INT128__)
+typedef unsigned __int128 kmer_code_t;
+#else
+typedef uint64_t kmer_code_t;
+#endif
+
+// Hash function for k-mer codes of either width, folding the high half of a wide code into the low
+struct KmerCodeHash {
+  size_t operator()(kmer_code_t code) const {
+    return (size_t) mix64((uint64_t) code ^ (uint64_t) (code >> 32 >> 32));
+  }
+};
+
+// Counts of the k-mers which occur in a sequence, keyed by lexicographic index
+typedef std::unordered_map<kmer_code_t, long, KmerCodeHash> SparseKmerCounts;
 
 class KmerCounter {
 
@@ -36,6 +77,151 @@ public:
    */
   void count(const std::string& sequence, long kmerCount[]);
 
+  /**
+   * Public Method: count
+   * --------------------
+   * Count k-mers in part of a sequence, adding results to the array passed as the last parameter
+   * @param sequence: Pointer to the first symbol to count k-mers in
+   * @param length: Number of symbols to count k-mers in
+   * @param kmerCount: Array of get_vector_size() counts to add results to
+   */
+  void count(const char* sequence, size_t length, long kmerCount[]);
+
+  /**
+   * Public Method: count
+   * --------------------
+   * Count k-mers in a sequence, adding results to the sparse counts passed as the second parameter.
+   * This works for any k-mer length that passes validate, including those too large for a dense vector.
+   * @param sequence: Sequence of symbols to count k-mers in
+   * @param kmerCount: Map from k-mer index to count to add results to
+   */
+  void count(const std::string& sequence, SparseKmerCounts& kmerCount);
+
+  /**
+   * Public Method: count
+   * --------------------
+   * Count k-mers in a sequence, adding results to a table which other threads may be adding to
+   * at the same time. Requires that has_64_bit_index returns true.
+   * @param sequence: Sequence of symbols to count k-mers in
+   * @param kmerCount: Lock-free table of k-mer counts to add results to
+   */
+  void count(const std::string& sequence, ConcurrentKmerTable& kmerCount);
+
+  /**
+   * Public Method: count
+   * --------------------
+   * Count k-mers in a sequence, adding results to a dense vector of narrow counters
+   * @param sequence: Sequence of symbols to count k-mers in
+   * @param kmerCount: Vector of get_vector_size() saturating counters to add results to
+   */
+  template<typename Counter>
+  void count(const std::string& sequence, SaturatingCounts<Counter>& kmerCount) {
+    for_each_kmer(sequence, [&kmerCount] (kmer_code_t index) { kmerCount.increment((uint64_t) index); });
+  }
+
+  /**
+   * Public Method: count_range
+   * --------------------------
+   * Count k-mers of every length from get_min_kmer_length() up to the k-mer length in one pass over the
+   * sequence. The codes of the shorter k-mers are derived from the rolling code of the longest.
+   * @param sequence: Sequence of symbols to count k-mers in
+   * @param kmerCounts: One array per k-mer length, kmerCounts[k - get_min_kmer_length()] having
+   * get_vector_size(k) elements, to add results to
+   */
+  void count_range(const std::string& sequence, long* kmerCounts[]);
+
+  /**
+   * Public Method: for_each_kmer
+   * ----------------------------
+   * Slides a window along the sequence, calling visit with the index of every k-mer that
+   * consists only of valid symbols (the canonical index in canonical mode)
+   * @param sequence: Sequence of symbols to find k-mers in
+   * @param visit: Callable taking the kmer_code_t index of each k-mer
+   */
+  template<typename Visitor>
+  void for_each_kmer(const std::string& sequence, Visitor visit) {
+    if (kmer_length == 0 || num_symbols == 0) return;
+    const uint8_t* codes = translate(sequence);
+    for_each_valid_run(sequence.size(), window_length(), [this, codes, &visit] (size_t start, size_t end) {
+      for_each_kmer(codes + start, end - start, visit);
+    });
+  }
+
+  /**
+   * Public Method: for_each_super_kmer
+   * ----------------------------------
+   * Splits a sequence into super-k-mers: maximal runs of consecutive k-mers which share a minimizer,
+   * the m-mer (m = MINIMIZER_LENGTH, or less for short k) with the least hash among those in the k-mer.
+   * Consecutive super-k-mers overlap by k - 1 symbols, but every k-mer of the sequence lies in exactly
+   * one of them. The minimizer depends only on the k-mer itself, so every occurrence of a k-mer is
+   * given the same minimizer, wherever it occurs.
+   * @param sequence: Sequence of symbols to split
+   * @param visit: Callable taking the start and end (exclusive) of each super-k-mer in the sequence,
+   * and the uint64_t hash of its minimizer
+   */
+  template<typename Visitor>
+  void for_each_super_kmer(const std::string& sequence, Visitor visit) {
+    if (kmer_length == 0 || num_symbols == 0) return;
+    const uint8_t* codes = translate(sequence);
+    const unsigned int span = window_length();
+
+    // Longest m-mer no longer than the window whose rolling index can't overflow 64 bits
+    unsigned int m = 0;
+    uint64_t m_significance = 1; // pow(num_symbols, m)
+    while (m < MINIMIZER_LENGTH && m < span && m_significance <= UINT64_MAX / num_symbols / num_symbols) {
+      m_significance *= num_symbols;
+      m++;
+    }
+
+    static thread_local std::vector<uint64_t> hashes; // Hash of the m-mer at each position of a run
+    for_each_valid_run(sequence.size(), span, [&] (size_t start, size_t end) {
+      const size_t num_mmers = end - start - m + 1;
+      hashes.resize(num_mmers);
+      uint64_t mmer = 0;
+      for (size_t i = start; i < end; i++) {
+        mmer = (mmer * num_symbols + codes[i]) % m_significance;
+        if (i + 1 >= start + m) hashes[i + 1 - start - m] = KmerCodeHash()(mmer);
+      }
+
+      // Slide the window of m-mers under each k-mer, rescanning only when the least leaves it
+      const size_t window = span - m + 1;
+      const size_t num_kmers = end - start - span + 1;
+      size_t least = 0;
+      size_t group = 0; // First k-mer of the current super-k-mer
+      for (size_t j = 0; j < num_kmers; j++) {
+        size_t previous = least;
+        if (j == 0 || least < j) {
+          least = j;
+          for (size_t p = j + 1; p < j + window; p++) if (hashes[p] < hashes[least]) least = p;
+        } else if (hashes[j + window - 1] < hashes[least]) {
+          least = j + window - 1;
+        }
+        if (j > 0 && least != previous) {
+          visit(start + group, start + j - 1 + span, hashes[previous]);
+          group = j;
+        }
+      }
+      visit(start + group, start + num_kmers - 1 + span, hashes[least]);
+    });
+  }
+
+  /**
+   * Public Method: get_skipped_bases
+   * --------------------------------
+   * @return: The number of invalid symbols (e.g. N) in the last sequence counted by the calling thread,
+   * none of which are part of any counted k-mer
+   */
+  static uint64_t get_skipped_bases();
+
+  /**
+   * Public Method: get_skipped_bases
+   * --------------------------------
+   * @param length: A number of symbols no greater than the length of the last sequence counted
+   * @return: The number of invalid symbols among the first length symbols of the last sequence counted
+   * by the calling thread
+   */
+  static uint64_t get_skipped_bases(size_t length);
+
   /**
    * Public Method: set_symbols
    * -------------------------
@@ -52,28 +238,317 @@ public:
    */
   void set_kmer_length(unsigned int kmer_length);
 
+  /**
+   * Public Method: set_min_kmer_length
+   * ----------------------------------
+   * Sets the shortest k-mer length counted by count_range. Zero (the default) or the k-mer length
+   * itself means that only k-mers of the k-mer length are counted.
+   * @param min_kmer_length: The shortest k-mer length to count
+   */
+  void set_min_kmer_length(unsigned int min_kmer_length);
+
+  /**
+   * Public Method: set_spaced_seed
+   * ------------------------------
+   * Sets a spaced seed such as "1101011" that selects the symbols of each k-mer from a window (see
+   * SpacedSeedEngine). This sets the k-mer length to the number of '1's in the seed, so counts are
+   * laid out exactly as for contiguous k-mers of that length. An empty seed counts contiguous k-mers.
+   * @param seed: String of '1' (care) and '0' (don't care) positions, beginning and ending with '1'
+   */
+  void set_spaced_seed(const std::string& seed);
+
+  /**
+   * Public Method: get_min_kmer_length
+   * ----------------------------------
+   * @return: The shortest k-mer length counted by count_range
+   */
+  unsigned int get_min_kmer_length() const { return counting_range() ? min_kmer_length : kmer_length; }
+
+  /**
+   * Public Method: get_kmer_length
+   * ------------------------------
+   * @return: The k-mer length, which is the longest k-mer length counted by count_range
+   */
+  unsigned int get_kmer_length() const { return kmer_length; }
+
+  /**
+   * Public Method: window_length
+   * ----------------------------
+   * @return: The number of symbols under the window from which each k-mer is taken, which is the span
+   * of the spaced seed if there is one and the k-mer length otherwise
+   */
+  unsigned int window_length() const { return use_seed ? seed_engine.get_span() : kmer_length; }
+
+  /**
+   * Public Method: counting_range
+   * -----------------------------
+   * @return: True if a range of k-mer lengths is being counted (see set_min_kmer_length)
+   */
+  bool counting_range() const { return min_kmer_length != 0 && min_kmer_length < kmer_length; }
+
+  /**
+   * Public Method: set_canonical
+   * ----------------------------
+   * Sets whether future calls to count collapse each k-mer with its reverse complement. In canonical
+   * mode every k-mer is counted at the lesser of its own index and the index of its reverse
+   * complement, so only canonical indices (see is_canonical_index) are ever written to.
+   * @param canonical: True to count canonical k-mers
+   */
+  void set_canonical(bool canonical) { this->canonical = canonical; }
+
+  /**
+   * Public Method: set_partitioned
+   * ------------------------------
+   * Sets whether future calls to count into dense vectors of longs radix-partition k-mer indices into
+   * cache-sized buckets before counting them (see PartitionedCounter). This only takes effect for
+   * vectors of PARTITION_MIN_VECTOR_SIZE to PARTITION_MAX_VECTOR_SIZE counts, which would otherwise
+   * not fit in cache, and for sequences long enough to fill a block of indices.
+   * @param partitioned: True to partition k-mer indices before counting
+   */
+  void set_partitioned(bool partitioned) { this->partitioned = partitioned; }
+
+  /**
+   * Public Method: supports_canonical
+   * ---------------------------------
+   * @return: True if canonical counting is possible for the current symbols and k-mer length. This
+   * requires a power of two number of symbols (e.g. DNA) each of which has its complement among the symbols.
+   */
+  bool supports_canonical() const { return has_complement && use_packed_engine; }
+
+  /**
+   * Public Method: counting_canonical
+   * ---------------------------------
+   * @return: True if k-mers are being counted together with their reverse complements
+   */
+  bool counting_canonical() const { return canonical && supports_canonical(); }
+
+  /**
+   * Public Method: is_canonical_index
+   * ---------------------------------
+   * @param index: Lexicographic index of a k-mer
+   * @return: True if the k-mer is no greater than its reverse complement. Always true unless canonical
+   * counting is enabled.
+   */
+  bool is_canonical_index(uint64_t index) const {
+    return !counting_canonical() || index <= packed_engine.reverse_complement(index);
+  }
+  bool is_canonical_index(uint64_t index, unsigned int length) const {
+    return !counting_canonical() || index <= packed_engine.reverse_complement(index, length);
+  }
+
+  /**
+   * Public Method: set_memory_budget
+   * --------------------------------
+   * Sets the largest dense count vector, in bytes, that is_dense allows
+   * @param bytes: The memory budget of one dense count vector
+   */
+  void set_memory_budget(uint64_t bytes) { memory_budget = bytes; }
+
+  /**
+   * Public Method: get_memory_budget
+   * --------------------------------
+   * @return: The memory budget of one dense count vector, in bytes
+   */
+  uint64_t get_memory_budget() const { return memory_budget; }
+
+  /**
+   * Public Method: is_dense
+   * -----------------------
+   * @param counter_size: The size in bytes of each counter in the dense vector
+   * @return: True if k-mers should be counted into a dense vector of get_vector_size() counters, false
+   * if that vector would exceed the memory budget and SparseKmerCounts should be used instead. When
+   * counting a range of k-mer lengths, the vectors of every length must fit in the budget together.
+   */
+  bool is_dense(size_t counter_size = sizeof(long)) const {
+    return vector_size_fits && range_vector_size <= memory_budget / counter_size;
+  }
+
+  /**
+   * Public Method: has_64_bit_index
+   * -------------------------------
+   * @return: True if every k-mer index fits in 64 bits, so that a ConcurrentKmerTable can hold the counts
+   */
+  bool has_64_bit_index() const { return index_fits_64; }
+
+  /**
+   * Public Method: validate
+   * -----------------------
+   * Checks that k-mers can be counted with the current settings, throwing std::invalid_argument
+   * with a description of the problem if they cannot (e.g. k-mers too long for a kmer_code_t)
+   */
+  void validate() const;
+
   /**
    * Public Method: get_vector_size
    * ------------------------------
    * Returns the size of the vector in which k-mer counts will be stored which is equal
-   * to the number of unique k-mers of the given symbols and k-mer length
+   * to the number of unique k-mers of the given symbols and k-mer length. Only meaningful
+   * if is_dense returns true.
    */
-  unsigned int get_vector_size() { return kmer_count_vector_size; }
+  uint64_t get_vector_size() const { return kmer_count_vector_size; }
+
+  /**
+   * Public Method: get_vector_size
+   * ------------------------------
+   * @param length: A k-mer length no greater than the k-mer length
+   * @return: The number of unique k-mers of that length. Only meaningful if is_dense returns true.
+   */
+  uint64_t get_vector_size(unsigned int length) const;
+
+  /**
+   * Public Method: get_range_vector_size
+   * ------------------------------------
+   * @return: The total number of unique k-mers over every length counted by count_range. Only meaningful
+   * if is_dense returns true.
+   */
+  uint64_t get_range_vector_size() const { return range_vector_size; }
+
+  /**
+   * Public Method: kmer_string
+   * --------------------------
+   * @param index: Lexicographic index of a k-mer
+   * @return: The symbols of the k-mer with that index
+   */
+  std::string kmer_string(kmer_code_t index) const;
+
+  /**
+   * Public Method: kmer_index
+   * -------------------------
+   * @param kmer: The symbols of a k-mer of the current k-mer length
+   * @return: The lexicographic index of the k-mer, the inverse of kmer_string
+   * @throws std::invalid_argument: If the k-mer has the wrong length or a symbol not being counted
+   */
+  kmer_code_t kmer_index(const std::string& kmer) const;
 
 private:
   std::string symbols;
   unsigned int num_symbols = 0;
   unsigned int kmer_length = 0;
+  unsigned int min_kmer_length = 0; // Shortest k-mer length counted by count_range
 
   // The number of unique k-mers of the given symbols and k-mer length
   // kmer_count_vector_size = pow(num_symbols, kmer_length)
-  unsigned int kmer_count_vector_size = 0;
+  uint64_t kmer_count_vector_size = 0;
+  bool vector_size_fits = false;   // False if pow(num_symbols, kmer_length) overflows 64 bits
+  bool index_fits = false;         // False if the largest k-mer index overflows a kmer_code_t
+  bool index_fits_64 = false;      // False if the largest k-mer index overflows 64 bits
+  uint64_t range_vector_size = 0;  // Sum of the vector sizes of each k-mer length counted by count_range
+  uint64_t memory_budget = DEFAULT_MEMORY_BUDGET;
+
+  SequenceTranslator translator; // Maps each byte to the lexicographic index of its symbol
+
+  // The lexicographic significance of the first letter in a k-mer, pow(num_symbols, kmer_length - 1)
+  kmer_code_t leading_significance = 0;
 
-  std::map<char, int> symbol_index_map;
+  // pow(num_symbols, k) for each k less than kmer_length, used to take the last k symbols of an index
+  std::vector<kmer_code_t> suffix_moduli;
+
+  // Compile-time specialized kernel for this alphabet size and k-mer length, if there is one
+  kmer_kernel_t kernel = nullptr;
+
+  // Shift/mask engine used instead of the generic path when the alphabet size is a power of two
+  PackedKmerEngine packed_engine;
+  bool use_packed_engine = false;
+
+  // Gapped k-mers selected by a spaced seed, if there is one
+  std::string spaced_seed;
+  SpacedSeedEngine seed_engine;
+  bool use_seed = false;
+
+  // Canonical counting collapses k-mers with their reverse complements
+  bool canonical = false;
+  bool partitioned = false; // Radix-partition indices before counting into large dense vectors
+  bool has_complement = false;              // True if every symbol's complement is also a symbol
+  std::vector<uint8_t> complement_codes;    // Code of the complement of each symbol
 
   void populate_map();
-  int calculate_index(const char *kmer, const unsigned int *significances, int index);
-  unsigned int ipow(unsigned int base, unsigned int exp);
+  static std::string complement_of(char symbol);
+  void compute_sizes();
+  void select_engine();
+  const uint8_t* translate(const std::string& sequence) { return translate(sequence.data(), sequence.size()); }
+  const uint8_t* translate(const char* sequence, size_t length);
+  static const uint64_t* translated_invalid_mask();
+
+  /**
+   * Private Method: for_each_valid_run
+   * ----------------------------------
+   * Calls visit with the bounds of every maximal run of valid symbols in the sequence last translated
+   * by this thread that is long enough to hold a k-mer. Runs of invalid symbols are skipped 64
+   * positions at a time by scanning the bitmask of invalid positions.
+   * @param length: Number of symbols in the translated sequence
+   * @param min_run: The shortest run to visit
+   * @param visit: Callable taking the start and end (exclusive) of each run
+   */
+  template<typename RunVisitor>
+  void for_each_valid_run(size_t length, size_t min_run, RunVisitor visit) const {
+    const uint64_t* invalid_mask = translated_invalid_mask();
+    size_t start = SequenceTranslator::next_valid(invalid_mask, 0, length);
+    while (start < length) {
+      size_t end = SequenceTranslator::next_invalid(invalid_mask, start, length);
+      if (end - start >= min_run) visit(start, end);
+      start = SequenceTranslator::next_valid(invalid_mask, end, length);
+    }
+  }
+
+  /**
+   * Private Method: for_each_kmer
+   * -----------------------------
+   * Calls visit with the index of every valid k-mer in a translated sequence using the fastest
+   * engine available. The generic path rolls the index with a modulo by leading_significance.
+   */
+  template<typename Visitor>
+  void for_each_kmer(const uint8_t codes[], size_t length, Visitor visit) const {
+    if (use_seed) return seed_engine.for_each_kmer(codes, length, visit);
+    if (counting_canonical()) return packed_engine.for_each_canonical_kmer(codes, length, visit);
+    if (use_packed_engine) return packed_engine.for_each_kmer(codes, length, visit);
+
+    kmer_code_t index = 0;
+    unsigned int filled = 0; // Number of valid symbols under the window
+    for (size_t i = 0; i < length; i++) {
+      uint8_t code = codes[i];
+      if (code == SymbolEncoder::invalid) { // Window must be refilled after an invalid symbol
+        index = 0;
+        filled = 0;
+        continue;
+      }
+      if (filled == kmer_length) index %= leading_significance;
+      else filled++;
+      index = index * num_symbols + code;
+      if (filled == kmer_length) visit(index);
+    }
+  }
+
+  /**
+   * Private Method: for_each_kmer_suffix
+   * ------------------------------------
+   * Calls visit with the length and index of every valid k-mer of each length counted by count_range.
+   * The k-mers of each length ending at a position are suffixes of the longest k-mer ending there, so
+   * their indices are the rolling index of the longest k-mer modulo pow(num_symbols, k).
+   */
+  template<typename Visitor>
+  void for_each_kmer_suffix(const uint8_t codes[], size_t length, Visitor visit) const {
+    const unsigned int min_length = get_min_kmer_length();
+    if (use_packed_engine)
+      return packed_engine.for_each_kmer_suffix(codes, length, min_length, counting_canonical(), visit);
+
+    kmer_code_t index = 0;
+    unsigned int filled = 0; // Number of valid symbols under the window
+    for (size_t i = 0; i < length; i++) {
+      uint8_t code = codes[i];
+      if (code == SymbolEncoder::invalid) {
+        index = 0;
+        filled = 0;
+        continue;
+      }
+      if (filled == kmer_length) index %= leading_significance;
+      else filled++;
+      index = index * num_symbols + code;
+
+      unsigned int k = min_length;
+      for (; k <= filled && k < kmer_length; k++) visit(k, index % suffix_moduli[k]);
+      if (k == kmer_length && filled == kmer_length) visit(k, index);
+    }
+  }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,84 @@
+/**
+ * File: kmer-counting-session.hpp
+ * -------------------------------
+ * Presents the KmerCountingSession class, which counts the k-mers of a record fed to it a fragment at a
+ * time, so that a chromosome can be counted straight from a read buffer without first being collected
+ * into one string. Fragments may be of any length and may contain newlines, and k-mers spanning the
+ * boundary between two fragments are counted exactly once.
+ *
+ * Each fragment is counted together with the last window_length() - 1 symbols of the record before it,
+ * which is all of the rolling state that a k-mer spanning the boundary needs. The session therefore
+ * holds at most one fragment and a window of symbols, however long the record is.
+ *
+ * Usage:
+ *
+ * KmerCountingSession session(kmer_counter);
+ * session.begin_record(counts);
+ * while (...) session.feed(buffer, length);
+ * uint64_t skipped_bases = session.end_record();
+ */
+
+#ifndef _kmer_counting_session_
+#define _kmer_counting_session_
+
+#include "kmer-counter.hpp"
+#include <cstdint>
+#include <string>
+
+class KmerCountingSession {
+
+public:
+
+  /**
+   * Constructor
+   * -----------
+   * Creates a session counting with the symbols and k-mer length of a counter. A session may only be
+   * used by one thread at a time.
+   * @param kmer_counter: The counter to count k-mers with
+   */
+  explicit KmerCountingSession(KmerCounter& kmer_counter) : kmer_counter(kmer_counter) { }
+
+  /**
+   * Public Method: begin_record
+   * ---------------------------
+   * Starts counting a new record
+   * @param counts: Dense vector of get_vector_size() counts to add the k-mers of the record to
+   */
+  void begin_record(long counts[]);
+
+  /**
+   * Public Method: feed
+   * -------------------
+   * Counts the k-mers ending in the next fragment of the record
+   * @param fragment: The next symbols of the record. Newlines are ignored.
+   * @param length: Number of characters in the fragment
+   */
+  void feed(const char* fragment, size_t length);
+
+  /**
+   * Public Method: end_record
+   * -------------------------
+   * Finishes counting the record
+   * @return: The number of invalid symbols (e.g. N) in the record
+   */
+  uint64_t end_record();
+
+  /**
+   * Public Method: append_symbols
+   * -----------------------------
+   * Appends a fragment of a record to a sequence, leaving out newlines
+   * @param sequence: The sequence to append to
+   * @param fragment: The fragment to append
+   * @param length: Number of characters in the fragment
+   */
+  static void append_symbols(std::string& sequence, const char* fragment, size_t length);
+
+private:
+  KmerCounter& kmer_counter;
+  long* counts = nullptr;
+  std::string window;          // Symbols carried over from the last fragment, then those of the next
+  size_t carried = 0;          // Number of symbols at the front of window carried over
+  uint64_t skipped_bases = 0;  // Invalid symbols in the record so far
+};
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * File: kmer-kernels.hpp
+ * ----------------------
+ * Presents a family of k-mer counting kernels specialized at compile time on the k-mer length
+ * and the size of the alphabet. With both known to the compiler, the first-window recompute is
+ * fully unrolled and the modulo in the rolling update is strength-reduced to multiplications
+ * and shifts. Instances exist for DNA (4 symbols, k = 1..16) and protein (20 symbols, k = 1..5).
+ *
+ * Usage:
+ *
+ * kmer_kernel_t kernel = find_kmer_kernel(symbols.size(), kmer_length);
+ * if (kernel != nullptr) kernel(codes, length, kmerCount);
+ */
+
+#ifndef _kmer_kernels_
+#define _kmer_kernels_
+
+#include "symbol-encoder.hpp"
+#include <cstdint>
+#include <cstddef>
+
+#define DNA_KERNEL_MAX_K 16
+#define PROTEIN_KERNEL_MAX_K 5
+
+// Signature shared by every kernel in the family
+typedef void (*kmer_kernel_t)(const uint8_t codes[], size_t length, long kmerCount[]);
+
+// Compile-time integer exponentiation
+constexpr uint64_t kernel_pow(uint64_t base, unsigned int exp) {
+  return exp == 0 ? 1 : base * kernel_pow(base, exp - 1);
+}
+
+template<unsigned int K, unsigned int NumSymbols>
+struct KmerKernel {
+
+  // Lexicographic significance of the first symbol in the window
+  static constexpr uint64_t leading_significance = kernel_pow(NumSymbols, K - 1);
+
+  /**
+   * Static Method: count
+   * --------------------
+   * Count k-mers in a translated sequence, writing results to the array passed as the last parameter
+   * @param codes: Symbol codes of the sequence to count k-mers in (see SequenceTranslator)
+   * @param length: Number of symbols in the sequence
+   * @param kmerCount: Array of size NumSymbols^K to add counts to
+   */
+  static void count(const uint8_t codes[], size_t length, long kmerCount[]) {
+    size_t start = 0; // Start of the window
+    while (start + K <= length) {
+
+      // Recompute the index of a whole window. K is a constant so this loop is unrolled.
+      uint64_t index = 0;
+      unsigned int j;
+      for (j = 0; j < K; j++) {
+        uint8_t code = codes[start + j];
+        if (code == SymbolEncoder::invalid) break;
+        index = index * NumSymbols + code;
+      }
+      if (j < K) { // Invalid symbol under the window. Restart just past it.
+        start += j + 1;
+        continue;
+      }
+      kmerCount[index] += 1;
+
+      // Roll the window forward until the next invalid symbol
+      size_t next = start + K;
+      for (; next < length; next++) {
+        uint8_t code = codes[next];
+        if (code == SymbolEncoder::invalid) break;
+        index = (index % leading_significance) * NumSymbols + code;
+        kmerCount[index] += 1;
+      }
+      start = next + 1;
+    }
+  }
+};
+
+/**
+ * Function: find_kmer_kernel
+ * --------------------------
+ * Looks up the specialized kernel for an alphabet size and k-mer length
+ * @param num_symbols: The number of symbols in the alphabet
+ * @param kmer_length: The k-mer length
+ * @return: The kernel, or nullptr if there is no instance for these values
+ */
+kmer_kernel_t find_kmer_kernel(unsigned int num_symbols, unsigned int kmer_length);
+
+#endif
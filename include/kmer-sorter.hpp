@@ -0,0 +1,101 @@
+/**
+ * File: kmer-sorter.hpp
+ * ---------------------
+ * Presents the KmerSorter class, a k-mer counting engine based on sorting rather than hashing.
+ * 64-bit k-mer codes are appended to a buffer of bounded size. When the buffer fills, it is sorted
+ * in place with a parallel MSD radix sort on the thread pool and collapsed into (code, count) runs,
+ * which are merged with the runs of earlier buffers. Memory use is predictable (the buffer, plus one
+ * run per distinct k-mer), every pass accesses memory sequentially, and the counts come out sorted
+ * by code, as downstream set operations need.
+ *
+ * Usage:
+ *
+ * KmerSorter sorter(pool, buffer_size, 2 * kmer_length);
+ * kmer_counter.for_each_kmer(sequence, [&sorter] (kmer_code_t code) { sorter.add((uint64_t) code); });
+ * for (auto& kmer : sorter.collect()) { ... }  // (code, count) pairs in order of code
+ */
+
+#ifndef _kmer_sorter_
+#define _kmer_sorter_
+
+#include <threadpool.hpp>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+class KmerSorter {
+
+public:
+
+  /**
+   * Constructor
+   * -----------
+   * Creates a sorter with an empty buffer
+   * @param pool: Thread pool to sort buffers on
+   * @param buffer_size: The most codes to hold before sorting them into runs
+   * @param key_bits: The number of low bits of each code which may be set
+   */
+  KmerSorter(boost::threadpool::pool& pool, size_t buffer_size, unsigned int key_bits);
+
+  /**
+   * Public Method: add
+   * ------------------
+   * Adds one occurrence of a k-mer. Not safe to call from several threads at once.
+   * @param code: The 64-bit code of the k-mer
+   */
+  void add(uint64_t code) {
+    if (buffer.size() == buffer.capacity()) make_room();
+    buffer.push_back(code);
+  }
+
+  /**
+   * Public Method: collect
+   * ----------------------
+   * Sorts the codes still in the buffer and gives the count of every k-mer added
+   * @return: (code, count) pairs sorted by code
+   */
+  std::vector<std::pair<uint64_t, long>> collect();
+
+  /**
+   * Public Method: clear
+   * --------------------
+   * Forgets every k-mer added
+   */
+  void clear();
+
+  /**
+   * Static Method: merge_runs
+   * -------------------------
+   * Merges two lists of (code, count) runs, summing the counts of codes in both
+   * @param a: Runs sorted by code
+   * @param b: Runs sorted by code
+   * @return: The merged runs, sorted by code
+   */
+  static std::vector<std::pair<uint64_t, long>> merge_runs(const std::vector<std::pair<uint64_t, long>>& a,
+                                                          const std::vector<std::pair<uint64_t, long>>& b);
+
+  /**
+   * Static Method: radix_sort
+   * -------------------------
+   * Sorts codes in place with an MSD radix sort. The top digit is partitioned by the calling thread,
+   * and the buckets are then sorted in parallel on the pool.
+   * @param pool: Thread pool to sort buckets on
+   * @param codes: The codes to sort
+   * @param length: The number of codes
+   * @param key_bits: The number of low bits of each code which may be set
+   */
+  static void radix_sort(boost::threadpool::pool& pool, uint64_t codes[], size_t length, unsigned int key_bits);
+
+private:
+  boost::threadpool::pool& pool;
+  size_t buffer_size;
+  unsigned int key_bits;
+  std::vector<uint64_t> buffer;
+  std::vector<std::pair<uint64_t, long>> runs; // Counts of the codes of every buffer sorted so far
+
+  void make_room();
+  void flush();
+};
+
+#endif
@@ -0,0 +1,73 @@
+/**
+ * File: kmer-spectrum.hpp
+ * -----------------------
+ * Presents the KmerSpectrum class, a histogram of how many k-mers occur once, twice, three times and
+ * so on. Small counts, which hold nearly every k-mer, are tallied in an array and larger ones in a map.
+ * Spectra of parts of a set of counts may be built on separate threads and merged.
+ *
+ * Usage:
+ *
+ * KmerSpectrum spectrum;
+ * for (size_t i = 0; i < size; i++) spectrum.add(counts[i]);
+ * spectrum.for_each([&] (long count, uint64_t kmers) { out << count << ":" << kmers; });
+ */
+
+#ifndef _kmer_spectrum_
+#define _kmer_spectrum_
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Counts below this are tallied in an array rather than a map
+#define SPECTRUM_DIRECT_LIMIT 1024
+
+class KmerSpectrum {
+
+public:
+
+  KmerSpectrum() : direct(SPECTRUM_DIRECT_LIMIT, 0) { }
+
+  /**
+   * Public Method: add
+   * ------------------
+   * Tallies k-mers with the same count. Counts of zero (k-mers which did not occur) are ignored.
+   * @param count: The count of the k-mers
+   * @param kmers: The number of k-mers with that count
+   */
+  void add(long count, uint64_t kmers = 1) {
+    if (count <= 0) return;
+    if (count < SPECTRUM_DIRECT_LIMIT) direct[count] += kmers;
+    else large[count] += kmers;
+  }
+
+  /**
+   * Public Method: merge
+   * --------------------
+   * Adds the tallies of another spectrum into this one
+   * @param other: The spectrum to merge in
+   */
+  void merge(const KmerSpectrum& other) {
+    for (long count = 1; count < SPECTRUM_DIRECT_LIMIT; count++) direct[count] += other.direct[count];
+    for (auto& tally : other.large) large[tally.first] += tally.second;
+  }
+
+  /**
+   * Public Method: for_each
+   * -----------------------
+   * Calls visit with every count that some k-mer has, in increasing order
+   * @param visit: Callable taking the long count and the uint64_t number of k-mers with that count
+   */
+  template<typename Visitor>
+  void for_each(Visitor visit) const {
+    for (long count = 1; count < SPECTRUM_DIRECT_LIMIT; count++)
+      if (direct[count] > 0) visit(count, direct[count]);
+    for (auto& tally : large) visit(tally.first, tally.second);
+  }
+
+private:
+  std::vector<uint64_t> direct;      // Number of k-mers with each count below SPECTRUM_DIRECT_LIMIT
+  std::map<long, uint64_t> large;    // Number of k-mers with each larger count
+};
+
+#endif
@@ -34,8 +34,29 @@ private:
   bool debug;
   std::string symbols;
   size_t kmer_length;
+  size_t min_kmer_length; // Zero unless counting a range of k-mer lengths
+  std::string spaced_seed;
   bool sequential;
   bool sum_files;
+  bool canonical;
+  bool partitioned;
+  bool sorting;
+  size_t disk_buckets;
+  std::string temp_directory;
+  std::string sketch;
+  size_t sketch_width;
+  unsigned int sketch_depth;
+  bool cardinality;
+  unsigned int hll_precision;
+  std::string hll_output;
+  size_t bloom_filter; // MiB
+  bool bloom_exact;
+  bool spectrum;
+  size_t top_kmers;
+  size_t space_saving;
+  bool report_skipped;
+  size_t memory_budget; // MiB
+  unsigned int counter_bits;
 
   bool directory_count;
   bool from_stdin;
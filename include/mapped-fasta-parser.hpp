@@ -0,0 +1,164 @@
+/**
+ * File: mapped-fasta-parser.hpp
+ * -----------------------------
+ * Presents the MappedFastaParser class, which parses a regular FASTA file by mapping it into memory
+ * rather than reading it line by line. Records are given as views of their header and sequence straight
+ * into the mapping, so nothing is copied or allocated until a sequence is wanted as a string, and that
+ * may be done on any thread. Records are parsed as by FastaIterator.
+ *
+ * The mapping is advised to be read sequentially (MADV_SEQUENTIAL), so that the kernel reads ahead
+ * aggressively and may drop pages once they have been passed.
+ *
+ * A huge file may be parsed by several threads at once by splitting it into byte ranges, each parsed
+ * with a Range of its own. A range re-synchronizes on the first header ('>' at the start of a line)
+ * at or after its start, and a record belongs to the range in which its header begins, so every record
+ * is parsed by exactly one range. Records are numbered by their range and their index within it, which
+ * together give the order of the records in the file.
+ *
+ * Usage:
+ *
+ * auto parser = make_shared<MappedFastaParser>("sequences.fasta");
+ * FastaRecordView record;
+ * while (parser->next(record)) {
+ *   string header = record.header_string();
+ *   SequenceCursor cursor(record);
+ *   for (const char* line; size_t length = cursor.next(line);) { ... } // each line of the sequence
+ * }
+ *
+ * MappedFastaParser::Range range(*parser, i, n); // on the thread parsing range i of n
+ * while (range.next(record)) { ... }
+ */
+
+#ifndef _mapped_fasta_parser_
+#define _mapped_fasta_parser_
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+// A record of a mapped FASTA file, pointing into the mapping
+struct FastaRecordView {
+  const char* header = nullptr;    // Header line, '>' included and newline excluded
+  size_t header_length = 0;
+  const char* sequence = nullptr;  // Lines of the sequence, newlines included
+  size_t sequence_length = 0;
+  size_t range = 0;                // Byte range of the file the record was parsed from
+  size_t index = 0;                // Number of records before it in its range
+
+  std::string header_string() const { return std::string(header, header_length); }
+  std::string sequence_string() const;
+};
+
+// Iterates over the lines of the sequence of a record
+class SequenceCursor {
+
+public:
+  explicit SequenceCursor(const FastaRecordView& record) :
+    position(record.sequence), end(record.sequence + record.sequence_length) { }
+
+  /**
+   * Public Method: next
+   * -------------------
+   * Moves to the next non-empty line of the sequence
+   * @param line: Set to point at the line
+   * @return: The length of the line without its newline, or zero once there are no lines left
+   */
+  size_t next(const char*& line) {
+    while (position < end) {
+      const char* newline = (const char*) memchr(position, '\n', (size_t) (end - position));
+      if (newline == nullptr) newline = end;
+      line = position;
+      position = newline + (newline < end ? 1 : 0);
+      if (newline > line) return (size_t) (newline - line);
+    }
+    return 0;
+  }
+
+private:
+  const char* position;
+  const char* end;
+};
+
+class MappedFastaParser {
+
+public:
+
+  /**
+   * Constructor
+   * -----------
+   * Maps a FASTA file into memory
+   * @param fasta_file: Path to a regular FASTA file
+   * @throws std::runtime_error: If the file can't be opened or mapped
+   */
+  explicit MappedFastaParser(const std::string& fasta_file);
+  ~MappedFastaParser();
+
+  MappedFastaParser(const MappedFastaParser&) = delete;
+  MappedFastaParser& operator=(const MappedFastaParser&) = delete;
+
+  /**
+   * Public Method: is_mappable
+   * --------------------------
+   * @param fasta_file: Path to a file
+   * @return: True if the file is a regular file which may be mapped, rather than e.g. a pipe
+   */
+  static bool is_mappable(const std::string& fasta_file);
+
+  /**
+   * Public Method: next
+   * -------------------
+   * Parses the next record of the file. Views remain valid for as long as the parser exists.
+   * @param record: Set to the next record
+   * @return: True if there was another record, false at the end of the file
+   */
+  bool next(FastaRecordView& record);
+
+  /**
+   * Public Method: get_size
+   * -----------------------
+   * @return: The size of the file in bytes
+   */
+  size_t get_size() const { return size; }
+
+  // Cursor over the records whose headers begin within one of several byte ranges of the file
+  class Range {
+
+  public:
+
+    /**
+     * Constructor
+     * -----------
+     * Creates a cursor over one of several ranges of about equal size which together cover the file
+     * @param parser: The parser of the file, which must outlive the cursor
+     * @param range: Which range to parse, from 0 to num_ranges - 1
+     * @param num_ranges: The number of ranges the file is split into
+     */
+    Range(const MappedFastaParser& parser, size_t range, size_t num_ranges);
+
+    /**
+     * Public Method: next
+     * -------------------
+     * Parses the next record whose header begins in the range. Its sequence may run on past the range.
+     * @param record: Set to the next record
+     * @return: True if there was another record, false at the end of the range
+     */
+    bool next(FastaRecordView& record);
+
+  private:
+    const MappedFastaParser& parser;
+    size_t range;
+    size_t position;  // Where to parse the next record from
+    size_t end;       // End of the range
+    size_t index = 0; // Number of records parsed so far
+  };
+
+private:
+  const char* data = nullptr; // The mapping, or null if the file is empty
+  size_t size = 0;
+  size_t position = 0;        // Where to parse the next record from
+  size_t num_parsed = 0;      // Number of records given by next
+
+  bool parse(FastaRecordView& record, size_t& position, size_t end) const;
+};
+
+#endif
@@ -0,0 +1,27 @@
+/**
+ * File: mix64.hpp
+ * ---------------
+ * Presents mix64, the 64-bit finalizer of MurmurHash3, with which k-mer codes are hashed wherever
+ * they are spread over slots, counters or registers. Codes are lexicographic indices, so nearby
+ * k-mers have nearby codes; every bit of the result depends on every bit of the code.
+ *
+ * Usage:
+ *
+ * size_t slot = mix64(code) & mask;
+ */
+
+#ifndef _mix64_
+#define _mix64_
+
+#include <cstdint>
+
+inline uint64_t mix64(uint64_t code) {
+  code ^= code >> 33;
+  code *= 0xff51afd7ed558ccdULL;
+  code ^= code >> 33;
+  code *= 0xc4ceb9fe1a85ec53ULL;
+  code ^= code >> 33;
+  return code;
+}
+
+#endif
@@ -0,0 +1,211 @@
+/**
+ * File: packed-kmer-engine.hpp
+ * ----------------------------
+ * Presents the PackedKmerEngine class, a k-mer counting engine for alphabets whose size is a
+ * power of two (e.g. "ATGC"). Each symbol occupies a fixed number of bits, so the lexicographic
+ * index of the k-mer under the sliding window is kept in a 64-bit register and rolled forward with
+ * a shift, an OR and a mask instead of a division. The resulting indices are identical to the
+ * lexicographic layout used by KmerCounter, and k may be as large as 64 / bits_per_symbol
+ * (i.e. k = 32 for DNA).
+ *
+ * Given the code of each symbol's complement, the engine can also roll the index of the reverse
+ * complement of the window alongside the forward index, which is used for canonical counting.
+ */
+
+#ifndef _packed_kmer_engine_
+#define _packed_kmer_engine_
+
+#include "symbol-encoder.hpp"
+#include <cstdint>
+#include <vector>
+
+class PackedKmerEngine {
+
+public:
+
+  /**
+   * Constructor
+   * -----------
+   * Creates an engine for k-mers of length kmer_length over an alphabet of num_symbols symbols. The
+   * engine should only be constructed for values for which supports returns true.
+   * @param num_symbols: The size of the alphabet
+   * @param kmer_length: The length of the window/word length to count in sequences
+   */
+  PackedKmerEngine() = default;
+  PackedKmerEngine(size_t num_symbols, unsigned int kmer_length) :
+    bits(bits_per_symbol(num_symbols)), kmer_length(kmer_length) {
+    mask = bits * kmer_length >= 64 ? ~((uint64_t) 0) : (((uint64_t) 1) << (bits * kmer_length)) - 1;
+  }
+
+  /**
+   * Static Method: bits_per_symbol
+   * ------------------------------
+   * @param num_symbols: The size of the alphabet
+   * @return: log2(num_symbols) if num_symbols is a power of two greater than one, zero otherwise
+   */
+  static unsigned int bits_per_symbol(size_t num_symbols) {
+    if (num_symbols < 2 || num_symbols > 128 || (num_symbols & (num_symbols - 1))) return 0;
+    unsigned int bits = 0;
+    while (((size_t) 1 << bits) < num_symbols) bits++;
+    return bits;
+  }
+
+  /**
+   * Static Method: supports
+   * -----------------------
+   * @return: True if k-mers of the given length over an alphabet of this size fit in a 64-bit code
+   */
+  static bool supports(size_t num_symbols, unsigned int kmer_length) {
+    unsigned int bits = bits_per_symbol(num_symbols);
+    return bits != 0 && kmer_length != 0 && bits * kmer_length <= 64;
+  }
+
+  /**
+   * Public Method: for_each_kmer
+   * ----------------------------
+   * Slides a window along a translated sequence, calling visit with the lexicographic index of
+   * every k-mer that consists only of valid symbols
+   * @param codes: Symbol codes of the sequence to find k-mers in (see SequenceTranslator)
+   * @param length: Number of symbols in the sequence
+   * @param visit: Callable taking the uint64_t index of each k-mer
+   */
+  template<typename Visitor>
+  void for_each_kmer(const uint8_t codes[], size_t length, Visitor visit) const {
+    uint64_t index = 0;
+    unsigned int filled = 0; // Number of valid symbols under the window
+    for (size_t i = 0; i < length; i++) {
+      uint8_t code = codes[i];
+      if (code == SymbolEncoder::invalid) { // Window must be refilled after an invalid symbol
+        filled = 0;
+        continue;
+      }
+      index = ((index << bits) | code) & mask;
+      if (filled + 1 < kmer_length) filled++;
+      else visit(index);
+    }
+  }
+
+  /**
+   * Public Method: for_each_canonical_kmer
+   * --------------------------------------
+   * Slides a window along a translated sequence, calling visit with the canonical index of every
+   * valid k-mer: the lesser of the index of the k-mer and the index of its reverse complement.
+   * Requires that set_complement has been called.
+   * @param codes: Symbol codes of the sequence to find k-mers in (see SequenceTranslator)
+   * @param length: Number of symbols in the sequence
+   * @param visit: Callable taking the uint64_t canonical index of each k-mer
+   */
+  template<typename Visitor>
+  void for_each_canonical_kmer(const uint8_t codes[], size_t length, Visitor visit) const {
+    const unsigned int leading_shift = bits * (kmer_length - 1);
+    uint64_t index = 0;
+    uint64_t reverse_index = 0; // Index of the reverse complement of the window
+    unsigned int filled = 0;
+    for (size_t i = 0; i < length; i++) {
+      uint8_t code = codes[i];
+      if (code == SymbolEncoder::invalid) {
+        filled = 0;
+        continue;
+      }
+      index = ((index << bits) | code) & mask;
+      reverse_index = (reverse_index >> bits) | (((uint64_t) complement[code]) << leading_shift);
+      if (filled + 1 < kmer_length) filled++;
+      else visit(index < reverse_index ? index : reverse_index);
+    }
+  }
+
+  /**
+   * Public Method: for_each_kmer_suffix
+   * -----------------------------------
+   * Slides a window along a translated sequence, and for every position calls visit with the index of
+   * each valid k-mer of length min_length up to kmer_length ending there. The shorter k-mers are the
+   * low bits of the rolling index of the longest, so every length is counted in a single pass.
+   * @param codes: Symbol codes of the sequence to find k-mers in (see SequenceTranslator)
+   * @param length: Number of symbols in the sequence
+   * @param min_length: The shortest k-mer length to visit
+   * @param canonical: True to visit canonical indices (requires set_complement)
+   * @param visit: Callable taking the length and the uint64_t index of each k-mer
+   */
+  template<typename Visitor>
+  void for_each_kmer_suffix(const uint8_t codes[], size_t length, unsigned int min_length, bool canonical,
+                            Visitor visit) const {
+    const unsigned int leading_shift = bits * (kmer_length - 1);
+    uint64_t index = 0;
+    uint64_t reverse_index = 0;
+    unsigned int filled = 0;
+    for (size_t i = 0; i < length; i++) {
+      uint8_t code = codes[i];
+      if (code == SymbolEncoder::invalid) {
+        filled = 0;
+        continue;
+      }
+      index = ((index << bits) | code) & mask;
+      if (canonical) reverse_index = (reverse_index >> bits) | (((uint64_t) complement[code]) << leading_shift);
+      if (filled < kmer_length) filled++;
+
+      for (unsigned int k = min_length; k <= filled; k++) {
+        uint64_t suffix = index & suffix_mask(k);
+        if (canonical) { // The reverse complement of the suffix is the prefix of reverse_index
+          uint64_t reverse_suffix = reverse_index >> (bits * (kmer_length - k));
+          if (reverse_suffix < suffix) suffix = reverse_suffix;
+        }
+        visit(k, suffix);
+      }
+    }
+  }
+
+  /**
+   * Public Method: set_complement
+   * -----------------------------
+   * Sets the code of the complement of each symbol, for use by for_each_canonical_kmer
+   * @param complement_codes: complement_codes[c] is the code of the complement of symbol c
+   */
+  void set_complement(const std::vector<uint8_t>& complement_codes) {
+    for (size_t c = 0; c < complement_codes.size() && c < sizeof(complement); c++)
+      complement[c] = complement_codes[c];
+  }
+
+  /**
+   * Public Method: reverse_complement
+   * ---------------------------------
+   * @param index: Lexicographic index of a k-mer
+   * @param length: Length of the k-mer, if not kmer_length
+   * @return: Lexicographic index of the reverse complement of that k-mer
+   */
+  uint64_t reverse_complement(uint64_t index) const { return reverse_complement(index, kmer_length); }
+  uint64_t reverse_complement(uint64_t index, unsigned int length) const {
+    const uint64_t symbol_mask = (((uint64_t) 1) << bits) - 1;
+    uint64_t reverse_index = 0;
+    for (unsigned int i = 0; i < length; i++) {
+      reverse_index = (reverse_index << bits) | complement[index & symbol_mask];
+      index >>= bits;
+    }
+    return reverse_index;
+  }
+
+  /**
+   * Public Method: count
+   * --------------------
+   * Count k-mers in a translated sequence, writing results to the array passed as the last parameter
+   * @param codes: Symbol codes of the sequence to count k-mers in
+   * @param length: Number of symbols in the sequence
+   * @param kmerCount: Array of size num_symbols^kmer_length to add counts to
+   */
+  void count(const uint8_t codes[], size_t length, long kmerCount[]) const {
+    for_each_kmer(codes, length, [kmerCount] (uint64_t index) { kmerCount[index] += 1; });
+  }
+
+private:
+
+  // Selects the low bits of an index that hold the last k symbols
+  uint64_t suffix_mask(unsigned int k) const {
+    return bits * k >= 64 ? ~((uint64_t) 0) : (((uint64_t) 1) << (bits * k)) - 1;
+  }
+
+  unsigned int bits = 0;        // Number of bits used to store each symbol
+  unsigned int kmer_length = 0;
+  uint64_t mask = 0;            // Selects the low bits * kmer_length bits of the rolling index
+  uint8_t complement[128] = {}; // Code of the complement of each symbol
+};
+
+#endif
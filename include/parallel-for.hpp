@@ -0,0 +1,65 @@
+/**
+ * File: parallel-for.hpp
+ * ----------------------
+ * Presents parallel_for, which runs a number of independent tasks on a thread pool and returns once
+ * they are all done. Unlike scheduling the tasks and calling pool.wait(), it may be called from
+ * a task that is itself running on the pool: the calling thread runs every task that no helper
+ * has claimed yet, so it only ever waits on helpers which are already running.
+ *
+ * Usage:
+ *
+ * parallel_for(pool, buckets.size(), [&] (size_t i) { sort(buckets[i]); });
+ */
+
+#ifndef _parallel_for_
+#define _parallel_for_
+
+#include <threadpool.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+/**
+ * Function: parallel_for
+ * ----------------------
+ * Runs task(0) ... task(num_tasks - 1) on the calling thread and the threads of a pool
+ * @param pool: The pool to schedule helpers on
+ * @param num_tasks: The number of tasks
+ * @param task: Callable taking the number of a task. Called from several threads at once.
+ */
+inline void parallel_for(boost::threadpool::pool& pool, size_t num_tasks, std::function<void(size_t)> task) {
+  struct Progress {
+    std::function<void(size_t)> task;
+    size_t num_tasks;
+    std::atomic<size_t> next_task;
+    std::mutex lock;
+    std::condition_variable finished;
+    size_t num_finished = 0;
+  };
+  auto progress = std::make_shared<Progress>();
+  progress->task = std::move(task);
+  progress->num_tasks = num_tasks;
+  progress->next_task = 0;
+
+  // Helpers that start after every task is claimed return without running anything
+  auto work = [progress] () {
+    size_t num_run = 0;
+    for (size_t i; (i = progress->next_task++) < progress->num_tasks; num_run++) progress->task(i);
+    if (num_run == 0) return;
+    std::lock_guard<std::mutex> lock(progress->lock);
+    progress->num_finished += num_run;
+    progress->finished.notify_all();
+  };
+
+  size_t num_threads = pool.size() < num_tasks ? pool.size() : num_tasks;
+  for (size_t i = 1; i < num_threads; i++) pool.schedule(work);
+  work();
+
+  std::unique_lock<std::mutex> lock(progress->lock);
+  progress->finished.wait(lock, [&progress] () { return progress->num_finished == progress->num_tasks; });
+}
+
+#endif
@@ -0,0 +1,110 @@
+/**
+ * File: partitioned-counter.hpp
+ * -----------------------------
+ * Presents the PartitionedCounter class, which adds k-mer indices to a dense vector of counts in
+ * two phases. For k-mer lengths whose dense vector is far larger than the cache (e.g. k = 14 for
+ * DNA), incrementing each count as its k-mer is found is a random access to main memory. Instead,
+ * indices are buffered in blocks, and each block is radix-partitioned by the high bits of its indices
+ * into buckets that each cover a cache-sized slice of the vector. The buckets are then counted one
+ * after another, so the increments of each bucket stay within its slice while it is in cache.
+ *
+ * Each flush takes a prefix sum over, and clears, the offset of every bucket, so a block holds
+ * PARTITION_BUCKET_FILL indices per bucket on average and that pass is amortized over the block.
+ * Sequences too short to fill a block are better counted directly (see full_block_size).
+ *
+ * Usage:
+ *
+ * PartitionedCounter counter(kmerCount, vector_size, sequence_length);
+ * engine.for_each_kmer(codes, length, [&counter] (uint64_t index) { counter.add(index); });
+ * counter.flush();
+ */
+
+#ifndef _partitioned_counter_
+#define _partitioned_counter_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define PARTITION_BLOCK_SIZE (((size_t) 1) << 16) // Fewest indices buffered before partitioning (256 KiB)
+#define PARTITION_BUCKET_FILL 64                  // Indices buffered per bucket before partitioning
+#define PARTITION_SLICE_BITS 15                   // Each bucket covers 2^15 counts (256 KiB of longs)
+
+// Dense vectors of at least this many counts are worth partitioning (4096 buckets' worth, e.g. k = 14
+// for DNA): below it, counting directly was measured as fast or faster, the vector being largely
+// cached. Indices are buffered in 32 bits, so vectors must also have at most PARTITION_MAX_VECTOR_SIZE.
+#define PARTITION_MIN_VECTOR_SIZE (((uint64_t) 4096) << PARTITION_SLICE_BITS)
+#define PARTITION_MAX_VECTOR_SIZE (((uint64_t) 1) << 32)
+
+class PartitionedCounter {
+
+public:
+
+  /**
+   * Constructor
+   * -----------
+   * Creates a counter which adds to a dense vector of counts
+   * @param kmerCount: The dense vector of counts to add to
+   * @param vector_size: The number of counts in the vector, at most PARTITION_MAX_VECTOR_SIZE
+   * @param max_indices: An upper bound on the number of indices that will be added, used to size the
+   * block so that short sequences don't pay for a full block
+   */
+  PartitionedCounter(long kmerCount[], uint64_t vector_size, size_t max_indices) :
+    kmerCount(kmerCount), num_buckets((size_t) (vector_size >> PARTITION_SLICE_BITS) + 1),
+    block_size(std::min(max_indices, full_block_size(vector_size))),
+    block(block_size), partitioned(block_size), offsets(num_buckets + 1) { }
+
+  /**
+   * Public Method: full_block_size
+   * ------------------------------
+   * @param vector_size: The number of counts in a dense vector
+   * @return: The number of indices buffered before partitioning into the vector, at least
+   * PARTITION_BLOCK_SIZE and PARTITION_BUCKET_FILL per bucket
+   */
+  static size_t full_block_size(uint64_t vector_size) {
+    size_t num_buckets = (size_t) (vector_size >> PARTITION_SLICE_BITS) + 1;
+    return std::max(PARTITION_BLOCK_SIZE, num_buckets * PARTITION_BUCKET_FILL);
+  }
+
+  /**
+   * Public Method: add
+   * ------------------
+   * Adds one to the count of a k-mer, once the block it is buffered in is flushed
+   * @param index: Index of the k-mer
+   */
+  void add(uint64_t index) {
+    block[num_buffered++] = (uint32_t) index;
+    offsets[(index >> PARTITION_SLICE_BITS) + 1]++; // Histogram of bucket sizes
+    if (num_buffered == block_size) flush();
+  }
+
+  /**
+   * Public Method: flush
+   * --------------------
+   * Partitions the buffered indices into buckets by their high bits and counts them bucket by bucket.
+   * Must be called once every index has been added.
+   */
+  void flush() {
+    if (num_buffered == 0) return;
+
+    // Counting sort on the bucket of each index, the histogram having been taken in add
+    for (size_t b = 1; b <= num_buckets; b++) offsets[b] += offsets[b - 1];
+    for (size_t i = 0; i < num_buffered; i++) partitioned[offsets[block[i] >> PARTITION_SLICE_BITS]++] = block[i];
+
+    for (size_t i = 0; i < num_buffered; i++) kmerCount[partitioned[i]] += 1;
+    std::fill(offsets.begin(), offsets.end(), 0);
+    num_buffered = 0;
+  }
+
+private:
+  long* kmerCount;
+  const size_t num_buckets;
+  const size_t block_size;
+  size_t num_buffered = 0;
+  std::vector<uint32_t> block;       // Indices in the order they were found
+  std::vector<uint32_t> partitioned; // The same indices grouped by bucket
+  std::vector<size_t> offsets;       // Size, then start, of each bucket in partitioned
+};
+
+#endif
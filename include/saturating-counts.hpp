@@ -0,0 +1,90 @@
+/**
+ * File: saturating-counts.hpp
+ * ---------------------------
+ * Presents the SaturatingCounts class, a dense vector of k-mer counts stored in narrow
+ * (8, 16 or 32-bit) counters. Since most k-mers occur only a few times, narrow counters cut the
+ * memory footprint and bandwidth of a dense vector by 2-8x compared to longs. A counter which
+ * reaches its maximum value stays there and further occurrences spill into a side table, so
+ * the counts remain exact.
+ *
+ * Usage:
+ *
+ * SaturatingCounts<uint8_t> counts(kmer_counter.get_vector_size());
+ * kmer_counter.count(sequence, counts);
+ * long n = counts[index];
+ */
+
+#ifndef _saturating_counts_
+#define _saturating_counts_
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+
+template<typename Counter>
+class SaturatingCounts {
+
+public:
+
+  /**
+   * Constructor
+   * -----------
+   * Creates a vector of counters, all zero
+   * @param size: The number of counters (i.e. the number of unique k-mers)
+   */
+  explicit SaturatingCounts(uint64_t size) : num_counters(size), counters(new Counter[size]()) { }
+
+  /**
+   * Public Method: increment
+   * ------------------------
+   * Adds one to the count of a k-mer, spilling into the side table once its counter is saturated
+   * @param index: Index of the k-mer
+   */
+  void increment(uint64_t index) {
+    if (counters[index] != saturated) counters[index]++;
+    else spill[index]++;
+  }
+
+  /**
+   * Operator []
+   * -----------
+   * @param index: Index of a k-mer
+   * @return: The exact count of the k-mer
+   */
+  long operator[](uint64_t index) const {
+    long count = counters[index];
+    if (count == saturated) {
+      auto it = spill.find(index);
+      if (it != spill.end()) count += it->second;
+    }
+    return count;
+  }
+
+  /**
+   * Public Method: clear
+   * --------------------
+   * Resets every count to zero
+   */
+  void clear() {
+    memset(counters.get(), 0, sizeof(Counter) * num_counters);
+    spill.clear();
+  }
+
+  /**
+   * Public Method: size
+   * -------------------
+   * @return: The number of counters
+   */
+  uint64_t size() const { return num_counters; }
+
+private:
+  static const Counter saturated = std::numeric_limits<Counter>::max();
+
+  uint64_t num_counters;
+  std::unique_ptr<Counter[]> counters;
+  std::unordered_map<uint64_t, long> spill; // Occurrences beyond the saturated value of each counter
+};
+
+#endif
@@ -0,0 +1,136 @@
+/**
+ * File: sequence-translator.hpp
+ * -----------------------------
+ * Presents the SequenceTranslator class, which maps a sequence of ASCII symbols to their
+ * lexicographic indices ("codes") in one pass before any k-mers are counted. Alongside the codes
+ * it produces a bitmask with one bit set for every invalid position, 64 positions per word.
+ *
+ * The translation is vectorized with SSE4.2, AVX2 or AVX-512BW, 64 bytes at a time. The widest
+ * instruction set supported by the processor is selected from cpuid when the program starts,
+ * so a single binary runs on older and newer machines alike. Alphabets with too many symbols
+ * for the vector kernels, and machines without SSE4.2, use a scalar SymbolEncoder lookup.
+ *
+ * Usage:
+ *
+ * SequenceTranslator translator("ATGC");
+ * translator.translate(sequence.data(), sequence.size(), codes, invalid_mask);
+ * // codes[i] == SymbolEncoder::invalid iff bit (i % 64) of invalid_mask[i / 64] is set
+ *
+ * The bitmask lets runs of invalid symbols (e.g. N runs, or soft-masked regions when only upper case
+ * symbols are counted) be stepped over 64 positions at a time with next_valid and next_invalid.
+ */
+
+#ifndef _sequence_translator_
+#define _sequence_translator_
+
+#include "symbol-encoder.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#define TRANSLATOR_BLOCK_SIZE 64
+#define TRANSLATOR_MAX_PAIRS 32
+
+class SequenceTranslator {
+
+public:
+
+  // The (byte, code) pairs which the vector kernels compare each block against
+  struct Table {
+    uint8_t bytes[TRANSLATOR_MAX_PAIRS];
+    uint8_t codes[TRANSLATOR_MAX_PAIRS];
+    unsigned int num_pairs = 0;
+    bool fold_case = false; // Compare (byte | 0x20) so upper and lower case share one pair
+    bool vectorizable = false;
+  };
+
+  /**
+   * Constructor
+   * -----------
+   * Creates a translator for the provided symbols. Both upper and lower case forms of each
+   * symbol are recognized, exactly as by SymbolEncoder.
+   * @param symbols: The symbols which are recognized. Order determines lexicographic ordering
+   */
+  SequenceTranslator() = default;
+  explicit SequenceTranslator(const std::string& symbols) { set_symbols(symbols); }
+
+  /**
+   * Public Method: set_symbols
+   * --------------------------
+   * Rebuilds the translation tables for a new set of symbols
+   * @param symbols: The symbols which are recognized. Order determines lexicographic ordering
+   */
+  void set_symbols(const std::string& symbols);
+
+  /**
+   * Public Method: translate
+   * ------------------------
+   * Translates a sequence into symbol codes and a bitmask of invalid positions
+   * @param sequence: Sequence of symbols to translate
+   * @param length: Number of bytes in the sequence
+   * @param codes: Output array of length bytes. Invalid positions hold SymbolEncoder::invalid
+   * @param invalid_mask: Output array of (length + 63) / 64 words. Bit (i % 64) of word i / 64
+   * is set if position i is not a symbol
+   */
+  void translate(const char* sequence, size_t length, uint8_t codes[], uint64_t invalid_mask[]) const;
+
+  /**
+   * Public Method: get_encoder
+   * --------------------------
+   * @return: The scalar encoder that this translator agrees with
+   */
+  const SymbolEncoder& get_encoder() const { return encoder; }
+
+  /**
+   * Static Method: next_valid
+   * -------------------------
+   * Finds the first valid position at or after a position, scanning the invalid mask a word at a time
+   * @param invalid_mask: Bitmask of invalid positions from translate
+   * @param position: Position to start searching from
+   * @param length: Number of symbols in the sequence
+   * @return: The first valid position, or length if there is none
+   */
+  static size_t next_valid(const uint64_t invalid_mask[], size_t position, size_t length) {
+    return next_position(invalid_mask, position, length, ~((uint64_t) 0));
+  }
+
+  /**
+   * Static Method: next_invalid
+   * ---------------------------
+   * Finds the first invalid position at or after a position, scanning the invalid mask a word at a time
+   * @param invalid_mask: Bitmask of invalid positions from translate
+   * @param position: Position to start searching from
+   * @param length: Number of symbols in the sequence
+   * @return: The first invalid position, or length if there is none
+   */
+  static size_t next_invalid(const uint64_t invalid_mask[], size_t position, size_t length) {
+    return next_position(invalid_mask, position, length, 0);
+  }
+
+  /**
+   * Static Method: instruction_set
+   * ------------------------------
+   * @return: The name of the instruction set selected for translation on this machine
+   */
+  static const char* instruction_set();
+
+private:
+  SymbolEncoder encoder;
+  Table table;
+
+  // First position at or after position whose bit, exclusive-or flip, is set
+  static size_t next_position(const uint64_t invalid_mask[], size_t position, size_t length, uint64_t flip) {
+    if (position >= length) return length;
+    const size_t num_words = (length + TRANSLATOR_BLOCK_SIZE - 1) / TRANSLATOR_BLOCK_SIZE;
+    size_t word = position / TRANSLATOR_BLOCK_SIZE;
+    uint64_t bits = (invalid_mask[word] ^ flip) & (~((uint64_t) 0) << (position % TRANSLATOR_BLOCK_SIZE));
+    while (bits == 0) {
+      if (++word == num_words) return length;
+      bits = invalid_mask[word] ^ flip;
+    }
+    size_t found = word * TRANSLATOR_BLOCK_SIZE + __builtin_ctzll(bits);
+    return found < length ? found : length;
+  }
+};
+
+#endif
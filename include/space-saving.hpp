@@ -0,0 +1,91 @@
+/**
+ * File: space-saving.hpp
+ * ----------------------
+ * Presents the SpaceSaving class, which finds the most frequent k-mers of a stream in bounded memory
+ * with the Space-Saving algorithm of Metwally et al. A fixed number of (k-mer, count) counters are kept.
+ * A k-mer without a counter takes over the counter with the least count, inheriting that count as its
+ * possible overestimate. Any k-mer occurring more than total / capacity times is guaranteed a counter,
+ * and each count exceeds the true count by at most its error.
+ *
+ * Counters are kept in a min-heap indexed by a hash map, so each k-mer costs one lookup and a heap
+ * update. Summaries of parts of a stream (e.g. records counted on different threads) can be merged.
+ *
+ * Usage:
+ *
+ * SpaceSaving summary(1000);
+ * kmer_counter.for_each_kmer(sequence, [&summary] (kmer_code_t code) { summary.add((uint64_t) code); });
+ * for (auto& kmer : summary.top(10)) { ... } // (code, count) pairs, most frequent first
+ */
+
+#ifndef _space_saving_
+#define _space_saving_
+
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class SpaceSaving {
+
+public:
+
+  /**
+   * Constructor
+   * -----------
+   * Creates a summary with no counters in use
+   * @param capacity: The most k-mers to keep counters for
+   */
+  explicit SpaceSaving(size_t capacity);
+
+  /**
+   * Public Method: add
+   * ------------------
+   * Adds one occurrence of a k-mer. Not safe to call from several threads at once.
+   * @param code: The 64-bit code of the k-mer
+   */
+  void add(uint64_t code);
+
+  /**
+   * Public Method: merge
+   * --------------------
+   * Makes this the summary of both its stream and another's. A k-mer missing from one summary is taken
+   * to have that summary's least count there, which keeps every count an overestimate.
+   * @param other: The summary to merge in
+   */
+  void merge(const SpaceSaving& other);
+
+  /**
+   * Public Method: top
+   * ------------------
+   * @param n: The number of k-mers to give
+   * @return: (code, count) pairs of the n k-mers with the greatest counts, in decreasing order of count
+   * (then increasing order of code). Counts may overestimate by up to the least count in the summary.
+   */
+  std::vector<std::pair<uint64_t, long>> top(size_t n) const;
+
+  /**
+   * Public Method: min_count
+   * ------------------------
+   * @return: The least count of any counter if every counter is in use, zero otherwise. No k-mer without
+   * a counter occurs more often than this.
+   */
+  long min_count() const { return heap.size() < capacity ? 0 : heap.front().count; }
+
+private:
+  struct Counter {
+    uint64_t code;
+    long count;
+    long error;  // Count inherited from the k-mer the counter was taken from
+  };
+
+  size_t capacity;
+  std::vector<Counter> heap;                       // Min-heap by count
+  std::unordered_map<uint64_t, size_t> positions;  // Position of each k-mer's counter in heap
+
+  void sift_up(size_t i);
+  void sift_down(size_t i);
+  void swap_counters(size_t i, size_t j);
+};
+
+#endif
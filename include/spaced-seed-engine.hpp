@@ -0,0 +1,209 @@
+/**
+ * File: spaced-seed-engine.hpp
+ * ----------------------------
+ * Presents the SpacedSeedEngine class, which counts gapped k-mers selected by a spaced seed such as
+ * "1101011". The seed slides along the sequence as a window of span w = seed.size(), and the symbols
+ * under its '1' (care) positions form a k-mer of length weight = the number of '1's. Indices follow
+ * the same lexicographic layout as contiguous k-mers of length weight, so output of a seed reads
+ * exactly like output of -k weight.
+ *
+ * For alphabets whose size is a power of two, the window is rolled in a 64-bit register as in
+ * PackedKmerEngine, and the care positions are gathered with a single BMI2 PEXT instruction when the
+ * processor supports it (checked with cpuid on first use). Elsewhere, the care positions
+ * are gathered one run of adjacent care positions at a time with shifts and masks. Alphabets of other
+ * sizes compute each index from the symbols under the care positions.
+ *
+ * Usage:
+ *
+ * SpacedSeedEngine engine("1101011", symbols.size());
+ * engine.for_each_kmer(codes, length, [&] (uint64_t index) { kmerCount[index]++; });
+ */
+
+#ifndef _spaced_seed_engine_
+#define _spaced_seed_engine_
+
+#include "symbol-encoder.hpp"
+#include "packed-kmer-engine.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+class SpacedSeedEngine {
+
+public:
+
+  /**
+   * Constructor
+   * -----------
+   * Creates an engine for a spaced seed over an alphabet of num_symbols symbols. The seed should
+   * satisfy is_valid_seed.
+   * @param seed: String of '1' (care) and '0' (don't care) positions
+   * @param num_symbols: The size of the alphabet
+   */
+  SpacedSeedEngine() = default;
+  SpacedSeedEngine(const std::string& seed, size_t num_symbols) :
+    span((unsigned int) seed.size()), num_symbols((unsigned int) num_symbols),
+    bits(PackedKmerEngine::bits_per_symbol(num_symbols)) {
+    for (unsigned int i = 0; i < span; i++)
+      if (seed[i] == '1') care_offsets.push_back(i);
+
+    packed = bits != 0 && bits * span <= 64;
+    if (!packed) return;
+    window_mask = bits * span >= 64 ? ~((uint64_t) 0) : (((uint64_t) 1) << (bits * span)) - 1;
+
+    // The first symbol of the window is the most significant, so offset i occupies the bits at
+    // bits * (span - 1 - i). Runs of adjacent care positions are gathered together.
+    for (unsigned int i = 0; i < span;) {
+      if (seed[i] != '1') { i++; continue; }
+      unsigned int end = i;
+      while (end < span && seed[end] == '1') end++;
+      CareRun run;
+      run.shift = bits * (span - end);
+      run.width = bits * (end - i);
+      run.mask = run.width >= 64 ? ~((uint64_t) 0) : (((uint64_t) 1) << run.width) - 1;
+      care_runs.push_back(run);
+      care_mask |= run.mask << run.shift;
+      i = end;
+    }
+  }
+
+  /**
+   * Static Method: is_valid_seed
+   * ----------------------------
+   * @param seed: A candidate spaced seed
+   * @return: True if the seed consists of '0's and '1's, and begins and ends with '1'
+   */
+  static bool is_valid_seed(const std::string& seed) {
+    if (seed.empty() || seed.front() != '1' || seed.back() != '1') return false;
+    return seed.find_first_not_of("01") == std::string::npos;
+  }
+
+  /**
+   * Static Method: weight_of
+   * ------------------------
+   * @param seed: A spaced seed
+   * @return: The number of care positions, i.e. the length of the k-mers the seed selects
+   */
+  static unsigned int weight_of(const std::string& seed) {
+    unsigned int weight = 0;
+    for (char c : seed) weight += c == '1';
+    return weight;
+  }
+
+  /**
+   * Public Method: get_span
+   * -----------------------
+   * @return: The number of symbols under the window, care or not
+   */
+  unsigned int get_span() const { return span; }
+
+  /**
+   * Public Method: for_each_kmer
+   * ----------------------------
+   * Slides the seed along a translated sequence, calling visit with the lexicographic index of the
+   * symbols under the care positions of every window that consists only of valid symbols
+   * @param codes: Symbol codes of the sequence to find k-mers in (see SequenceTranslator)
+   * @param length: Number of symbols in the sequence
+   * @param visit: Callable taking the uint64_t index of each gapped k-mer
+   */
+  template<typename Visitor>
+  void for_each_kmer(const uint8_t codes[], size_t length, Visitor visit) const {
+    if (!packed) return for_each_kmer_generic(codes, length, visit);
+#if defined(__x86_64__)
+    if (has_pext()) return for_each_kmer_pext(codes, length, visit);
+#endif
+    for_each_window(codes, length, [this, &visit] (uint64_t window) {
+      uint64_t index = 0;
+      for (const CareRun& run : care_runs) index = (index << run.width) | ((window >> run.shift) & run.mask);
+      visit(index);
+    });
+  }
+
+private:
+
+  // A run of adjacent care positions within the packed window
+  struct CareRun {
+    unsigned int shift; // Position of the lowest bit of the run
+    unsigned int width; // Number of bits in the run
+    uint64_t mask;
+  };
+
+  unsigned int span = 0;
+  unsigned int num_symbols = 0;
+  unsigned int bits = 0;
+  bool packed = false;                   // True if the window fits in a 64-bit register
+  uint64_t window_mask = 0;
+  uint64_t care_mask = 0;                // Bits of the care positions within the packed window
+  std::vector<CareRun> care_runs;        // Most significant first
+  std::vector<unsigned int> care_offsets;
+
+  static bool has_pext() {
+#if defined(__x86_64__)
+    static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("bmi2"));
+    return supported;
+#else
+    return false;
+#endif
+  }
+
+  // Calls visit with each packed window of span valid symbols
+  template<typename WindowVisitor>
+  void for_each_window(const uint8_t codes[], size_t length, WindowVisitor visit) const {
+    uint64_t window = 0;
+    unsigned int filled = 0; // Number of valid symbols under the window
+    for (size_t i = 0; i < length; i++) {
+      uint8_t code = codes[i];
+      if (code == SymbolEncoder::invalid) {
+        filled = 0;
+        continue;
+      }
+      window = ((window << bits) | code) & window_mask;
+      if (filled < span) filled++;
+      if (filled == span) visit(window);
+    }
+  }
+
+#if defined(__x86_64__)
+  // PEXT packs the care bits of the window in order, which is exactly their lexicographic index. The
+  // loop is written out here since lambdas don't inherit the target attribute.
+  template<typename Visitor>
+  __attribute__((target("bmi2")))
+  void for_each_kmer_pext(const uint8_t codes[], size_t length, Visitor& visit) const {
+    uint64_t window = 0;
+    unsigned int filled = 0;
+    for (size_t i = 0; i < length; i++) {
+      uint8_t code = codes[i];
+      if (code == SymbolEncoder::invalid) {
+        filled = 0;
+        continue;
+      }
+      window = ((window << bits) | code) & window_mask;
+      if (filled < span) filled++;
+      if (filled == span) visit((uint64_t) _pext_u64(window, care_mask));
+    }
+  }
+#endif
+
+  template<typename Visitor>
+  void for_each_kmer_generic(const uint8_t codes[], size_t length, Visitor& visit) const {
+    unsigned int filled = 0;
+    for (size_t i = 0; i < length; i++) {
+      if (codes[i] == SymbolEncoder::invalid) {
+        filled = 0;
+        continue;
+      }
+      if (filled < span) filled++;
+      if (filled < span) continue;
+
+      const uint8_t* window = codes + i + 1 - span;
+      uint64_t index = 0;
+      for (unsigned int offset : care_offsets) index = index * num_symbols + window[offset];
+      visit(index);
+    }
+  }
+};
+
+#endif
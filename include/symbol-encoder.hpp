@@ -0,0 +1,76 @@
+/**
+ * File: symbol-encoder.hpp
+ * ------------------------
+ * Presents the SymbolEncoder class, a compiled lookup table that maps each byte of
+ * a sequence to the lexicographic index of its symbol. Both upper and lower case
+ * forms of every symbol are recognized. Bytes which are not symbols map to
+ * SymbolEncoder::invalid.
+ *
+ * Usage:
+ *
+ * SymbolEncoder encoder("ATGC");
+ * uint8_t code = encoder.encode('g'); // code == 2
+ * if (code == SymbolEncoder::invalid) { ... }
+ */
+
+#ifndef _symbol_encoder_
+#define _symbol_encoder_
+
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+class SymbolEncoder {
+
+public:
+
+  // Sentinel code for bytes which are not in the symbol set
+  static const uint8_t invalid = 0xFF;
+
+  /**
+   * Constructor
+   * -----------
+   * Creates an encoder for the provided symbols. The encoder constructed with no symbols
+   * treats every byte as invalid.
+   * @param symbols: The symbols which are recognized. Order determines lexicographic ordering
+   */
+  SymbolEncoder() { memset(table, invalid, sizeof(table)); }
+  explicit SymbolEncoder(const std::string& symbols) { set_symbols(symbols); }
+
+  /**
+   * Public Method: set_symbols
+   * --------------------------
+   * Rebuilds the lookup table for a new set of symbols
+   * @param symbols: The symbols which are recognized. Order determines lexicographic ordering
+   */
+  void set_symbols(const std::string& symbols) {
+    memset(table, invalid, sizeof(table));
+    for (size_t i = 0; i < symbols.size() && i < invalid; i++) {
+      table[(unsigned char) symbols[i]] = (uint8_t) i;
+      table[(unsigned char) tolower(symbols[i])] = (uint8_t) i;
+    }
+  }
+
+  /**
+   * Public Method: encode
+   * ---------------------
+   * Gives the lexicographic index of a symbol
+   * @param symbol: The byte to encode
+   * @return: The index of the symbol, or SymbolEncoder::invalid if it isn't a symbol
+   */
+  uint8_t encode(char symbol) const { return table[(unsigned char) symbol]; }
+
+  /**
+   * Public Method: is_valid
+   * -----------------------
+   * @param symbol: The byte to test
+   * @return: True if the byte is one of the symbols
+   */
+  bool is_valid(char symbol) const { return encode(symbol) != invalid; }
+
+private:
+  uint8_t table[256];
+};
+
+#endif
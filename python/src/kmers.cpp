@@ -1,13 +1,12 @@
 #include "kmers.h"
+#include "symbol-encoder.hpp"
 #include <cstdio>
-#include <map>
 #include <string.h>
 using namespace std;
 
 // Static function declarations
-static void populateMap(map<char, int>& symbolIndexMap, const char* symbols);
-static unsigned int calculateIndex(const char* kmer, const size_t kmerLength, map<char, int>& symbolIndexMap,
-                          const int* significances, const unsigned int numSymbols, int index);
+static int calculateIndex(const char* kmer, const unsigned int kmerLength, const SymbolEncoder& encoder,
+                          const unsigned int* significances, const unsigned int numSymbols, int index);
 static unsigned int ipow(unsigned int base, unsigned int exp);
 
 /**
@@ -32,8 +31,7 @@ int countKMers(const char* sequence, const int kmerLength, const char* symbols,
   if (numSymbols == 0) return 0;
 
   // Stores mapping from symbol to lexicographic index
-  map<char, int> symbolIndexMap;
-  populateMap(symbolIndexMap, symbols);
+  SymbolEncoder encoder(symbols);
 
   // Stores the lexocographic significance of each letter in a kmer
   unsigned int* significances = new unsigned int[kmerLength + 1];
@@ -48,58 +46,44 @@ int countKMers(const char* sequence, const int kmerLength, const char* symbols,
   size_t maximumIndex = sequenceLength - kmerLength;
   for (int i = 0; i <= maximumIndex; i++) {
     const char* kmer = sequence + i; // slide the window
-    index = calculateIndex(kmer, kmerLength, symbolIndexMap, significances, numSymbols, index);
+    index = calculateIndex(kmer, kmerLength, encoder, significances, numSymbols, index);
     if (index >= 0) kmerCount[index] += 1; // Valid kmer encountered
     //else i -= (index + 1); // Invalid character encountered. Advance window past it.
   }
+  delete[] significances;
   return 0;
 }
 
-/**
- * Function: populateMap
- * ---------------------
- * Populates a map of
- * @param symbolIndexMap: The map to populate
- * @param symbols: The symbols to populate it with
- */
-static void populateMap(map<char, int>& symbolIndexMap, const char* symbols) {
-  int numSymbols = strlen(symbols);
-  for (int i = 0; i < numSymbols; i++) {
-    symbolIndexMap[symbols[i]] = i;
-    symbolIndexMap[tolower(symbols[i])] = i;
-  }
-}
-
 /**
  * Function: calculateIndex
  * ------------------------
  * This function calculates the index of the kmer in the kmer array where its stored
  * @param kmer
  * @param kmerLength
- * @param symbolIndexMap
+ * @param encoder: Lookup table from symbol to lexicographic index
  * @param significances
  * @param numSymbols
  * @param index
  * @return
  */
-static unsigned int calculateIndex(const char* kmer, const unsigned int kmerLength, map<char, unsigned int>& symbolIndexMap,
-                          const int* significances, const int numSymbols, int index) {
+static int calculateIndex(const char* kmer, const unsigned int kmerLength, const SymbolEncoder& encoder,
+                          const unsigned int* significances, const unsigned int numSymbols, int index) {
   if (index < 0) {
     // Must recalculate
     // index = sum([lookup[kmer[n]] * pow(num_symbols, kmer_length - n - 1) for n in xrange(kmer_length)])
     index = 0;
-    for (int j = 0; j < kmerLength; j++) {
-      // char letter = kmer[j];
-      if (symbolIndexMap.find(kmer[j]) == symbolIndexMap.end()) return -(j + 1); // invalid next symbol
-      index += symbolIndexMap[kmer[j]] * significances[kmerLength - j - 1];
+    for (unsigned int j = 0; j < kmerLength; j++) {
+      uint8_t code = encoder.encode(kmer[j]);
+      if (code == SymbolEncoder::invalid) return -(j + 1); // invalid next symbol
+      index += code * significances[kmerLength - j - 1];
     }
   } else {
     // May use previous window's index to make a quicker calculation
     // index = (index * num_symbols) % pow(num_symbols, kmer_length) + lookup[sequence[i + kmer_length - 1]]
-    // char letter = kmer[kmerLength - 1];
-    if (symbolIndexMap.find(kmer[kmerLength - 1]) == symbolIndexMap.end()) return -kmerLength;
-    // index = (index * numSymbols) % significances[kmerLength] + symbolIndexMap[letter];
-    index = ((index % significances[kmerLength - 1]) * numSymbols) + symbolIndexMap[kmer[kmerLength - 1]];
+    uint8_t code = encoder.encode(kmer[kmerLength - 1]);
+    if (code == SymbolEncoder::invalid) return -kmerLength;
+    // index = (index * numSymbols) % significances[kmerLength] + code;
+    index = ((index % significances[kmerLength - 1]) * numSymbols) + code;
   }
   return index;
 }
@@ -6,8 +6,15 @@
 
 #include "async-kmer-counter.hpp"
 #include "ostreamlock.hpp"
+#include "parallel-for.hpp"
 
 #include <boost/filesystem.hpp>
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
 using namespace std;
 
 AsyncKmerCounter::AsyncKmerCounter(boost::threadpool::pool& pool) : pool(pool), sum_files(false) { }
@@ -24,48 +31,865 @@ void AsyncKmerCounter::count(istream& in, ostream& out, bool sequential, bool bl
 }
 
 void AsyncKmerCounter::count_sequential(istream &in, ostream &out) {
+  if (kmer_counter.counting_range()) return count_range_sequential(in, out);
+  if (cardinality_precision > 0) return count_cardinality(in, out, false, true);
+  if (!sketch.empty()) return count_sketch(in, out, false);
+  if (space_saving > 0) return count_heavy_hitters(in, out, false, true);
+  if (disk_buckets > 0) return count_partitioned(in, out, false);
+  if (sorting) return count_sorted_sequential(in, out);
+  if (bloom_bytes > 0) return count_filtered(in, out, false);
+  if (!is_dense()) return count_sparse_sequential(in, out);
+  if (counter_bits == 8) return count_narrow_sequential<uint8_t>(in, out);
+  if (counter_bits == 16) return count_narrow_sequential<uint16_t>(in, out);
+  if (counter_bits == 32) return count_narrow_sequential<uint32_t>(in, out);
 
   // Must use heap because variable length array
   // sequential counting means that we can reuse the same array though
   long* counts = (long*) malloc(sizeof(long) * kmer_counter.get_vector_size());
 
+  // Records are streamed through a counting session rather than collected into strings, so that a
+  // chromosome is counted in constant memory. The start of each record is held back until the record
+  // is known not to be short.
+  KmerCountingSession session(kmer_counter);
+  string header, start;
+  bool streaming = false;
+
   FastaParser parser(&in);
-  for (auto it = parser.begin(); it != parser.end(); ++it) {
+  parser.stream([&] (const string& record) {
+    header = record;
+    start.clear();
+    streaming = false;
+  }, [&] (const char* fragment, size_t length) {
+    if (streaming) return session.feed(fragment, length);
+    KmerCountingSession::append_symbols(start, fragment, length);
+    if (is_short_record(start.size())) return;
+
     memset(counts, 0, sizeof(long) * kmer_counter.get_vector_size());
-    kmer_counter.count(it->second.str(), counts);
+    session.begin_record(counts);
+    session.feed(start.data(), start.size());
+    streaming = true;
+  }, [&] () {
+    if (!streaming) {
+      auto kmers = count_short(start);
+      write_short_counts(out, record_header(parser.parse_header(header)), kmers);
+      return;
+    }
 
     // Output to file
-    out << parser.parse_header(it->first);
-    for (size_t i = 0; i < kmer_counter.get_vector_size(); i++)
-      out << ", " << counts[i];
-    out << endl;
-  }
+    uint64_t skipped_bases = session.end_record();
+    write_counts(out, record_header(parser.parse_header(header), skipped_bases), counts,
+                 kmer_counter.get_kmer_length());
+  });
   free(counts);
 }
 
 // Asynchronous counting
 void AsyncKmerCounter::count_async(istream &in, ostream &out, bool block) {
+  if (kmer_counter.counting_range()) return count_range_async(in, out, block);
+  if (cardinality_precision > 0) return count_cardinality(in, out, true, block);
+  if (!sketch.empty()) return count_sketch(in, out, true);
+  if (space_saving > 0) return count_heavy_hitters(in, out, true, block);
+  if (disk_buckets > 0) return count_partitioned(in, out, true);
+  if (sorting) return count_sorted_async(in, out, block);
+  if (bloom_bytes > 0) return count_filtered(in, out, true);
+  if (!is_dense()) return count_sparse_async(in, out, block);
+  if (counter_bits == 8) return count_narrow_async<uint8_t>(in, out, block);
+  if (counter_bits == 16) return count_narrow_async<uint16_t>(in, out, block);
+  if (counter_bits == 32) return count_narrow_async<uint32_t>(in, out, block);
+
   FastaParser parser(&in);
   for (auto it = parser.begin(); it != parser.end(); ++it) {
-    shared_ptr<pair<string, ostringstream>> record = *it;
+    shared_ptr<pair<string, string>> record = *it;
 
     pool.schedule([&, record] () {
+      const string& sequence = record->second;
+      if (is_short_record(sequence.size())) {
+        auto kmers = count_short(sequence);
+        write_short_counts(out, record_header(parser.parse_header(record->first)), kmers);
+        return;
+      }
+
       long* counts = (long*) malloc(sizeof(long) * kmer_counter.get_vector_size());
       
       memset(counts, 0, sizeof(long) * kmer_counter.get_vector_size());
-      kmer_counter.count(record->second.str(), counts);
+      uint64_t skipped_bases = count_dense(sequence, counts);
 
-      out << oslock << parser.parse_header(record->first);
-      for (size_t i = 0; i < kmer_counter.get_vector_size(); i++) out << ", " << counts[i];
-      out << endl << osunlock;
+      write_counts(out, record_header(parser.parse_header(record->first), skipped_bases), counts,
+                   kmer_counter.get_kmer_length());
       free(counts);
     });
   }
   if (block) pool.wait();
 }
 
+/**
+ * Private method: count_dense
+ * ---------------------------
+ * Counts the k-mers of one record into a dense vector of counts on a pool thread. Records of at least
+ * PARALLEL_RECORD_THRESHOLD symbols are split into chunks counted by several threads at once, as many
+ * as the pool has and the memory budget allows each a vector of counts of its own.
+ * @param sequence: The sequence to count k-mers in
+ * @param counts: Dense vector of counts to add results to
+ * @return: The number of invalid symbols skipped in the sequence
+ */
+uint64_t AsyncKmerCounter::count_dense(const string& sequence, long counts[]) {
+  const uint64_t vector_bytes = sizeof(long) * kmer_counter.get_vector_size();
+  size_t num_threads = (size_t) min((uint64_t) pool.size(), kmer_counter.get_memory_budget() / vector_bytes);
+  bool split = sequence.size() >= PARALLEL_RECORD_THRESHOLD && sequence.size() >= kmer_counter.get_vector_size();
+  if (!split || num_threads < 2) {
+    kmer_counter.count(sequence, counts);
+    return KmerCounter::get_skipped_bases();
+  }
+  return count_chunked(sequence, counts, num_threads - 1);
+}
+
+/**
+ * Private method: count_chunked
+ * -----------------------------
+ * Counts the k-mers of a long sequence on several threads at once. The sequence is split into chunks of
+ * PARALLEL_CHUNK_SIZE k-mer start positions, each extended by window_length() - 1 symbols into the next,
+ * so that every k-mer lies wholly within exactly one chunk. The calling thread and helpers scheduled on the
+ * pool claim chunks in turn, each counting into a vector of its own which is added into counts once it runs
+ * out of chunks. Since the calling thread counts any chunks that no helper has claimed, it only ever waits
+ * on helpers which are already counting, never on tasks still queued behind it.
+ * @param sequence: The sequence to count k-mers in
+ * @param counts: Dense vector of counts to add results to. Identical to counting the sequence serially.
+ * @param num_helpers: The number of helper tasks to schedule on the pool
+ * @return: The number of invalid symbols skipped in the sequence
+ */
+uint64_t AsyncKmerCounter::count_chunked(const string& sequence, long counts[], size_t num_helpers) {
+  auto state = make_shared<ChunkedCount>();
+  state->sequence = sequence.data();
+  state->length = sequence.size();
+  state->num_chunks = (sequence.size() + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+  state->counts = counts;
+  state->next_chunk = 0;
+
+  // Helpers that start after every chunk is claimed return without touching the sequence
+  for (size_t i = 0; i < min(num_helpers, state->num_chunks - 1); i++)
+    pool.schedule([this, state] () { count_chunks(*state); });
+  count_chunks(*state);
+
+  unique_lock<mutex> lock(state->lock);
+  state->merged.wait(lock, [&state] () { return state->num_merged == state->num_chunks; });
+  return state->skipped_bases;
+}
+
+/**
+ * Private method: count_chunks
+ * ----------------------------
+ * Claims and counts chunks of a record until there are none left, then adds the counts into the record's
+ * vector of counts
+ * @param state: The record being counted in chunks
+ */
+void AsyncKmerCounter::count_chunks(ChunkedCount& state) {
+  const size_t overlap = kmer_counter.window_length() - 1; // The span of a spaced seed, not its weight
+  vector<long> chunk_counts;
+  size_t num_counted = 0;
+  uint64_t skipped_bases = 0;
+
+  for (size_t chunk; (chunk = state.next_chunk++) < state.num_chunks; num_counted++) {
+    if (chunk_counts.empty()) chunk_counts.assign(kmer_counter.get_vector_size(), 0);
+    size_t start = chunk * PARALLEL_CHUNK_SIZE;
+    size_t length = min(PARALLEL_CHUNK_SIZE, state.length - start);
+    kmer_counter.count(state.sequence + start, min(length + overlap, state.length - start), chunk_counts.data());
+    skipped_bases += KmerCounter::get_skipped_bases(length); // Overlap belongs to the next chunk
+  }
+  if (num_counted == 0) return;
+
+  lock_guard<mutex> lock(state.lock);
+  for (size_t i = 0; i < chunk_counts.size(); i++) state.counts[i] += chunk_counts[i];
+  state.skipped_bases += skipped_bases;
+  state.num_merged += num_counted;
+  state.merged.notify_all();
+}
+
+/**
+ * Private method: count_short
+ * ---------------------------
+ * Counts the k-mers of a record too short to be worth zeroing a dense vector of counts for (see
+ * is_short_record) by sorting the codes of its k-mers
+ * @param sequence: The sequence to count k-mers in
+ * @return: (index, count) pairs for the k-mers which occur, in lexicographic order
+ */
+vector<pair<kmer_code_t, long>> AsyncKmerCounter::count_short(const string& sequence) {
+  static thread_local vector<kmer_code_t> codes;
+  codes.clear();
+  kmer_counter.for_each_kmer(sequence, [] (kmer_code_t code) { codes.push_back(code); });
+  sort(codes.begin(), codes.end());
+
+  vector<pair<kmer_code_t, long>> counts;
+  for (kmer_code_t code : codes) {
+    if (counts.empty() || counts.back().first != code) counts.emplace_back(code, 0);
+    counts.back().second++;
+  }
+  return counts;
+}
+
+/*
+ * Counting a regular file through a mapping. The file is split into byte ranges, one per thread, which
+ * are parsed concurrently on the pool, each scheduling its records to be counted as it finds them, so
+ * parsing a single huge file is not limited to one core. A record's sequence is gathered out of the
+ * mapping by the thread which counts it. Sequential dense counting feeds long records to a counting
+ * session straight from the mapping, without ever gathering them.
+ */
+void AsyncKmerCounter::count_mapped(const string& fasta_file, ostream& out, bool sequential, bool block) {
+  shared_ptr<MappedFastaParser> parser;
+  try {
+    parser = make_shared<MappedFastaParser>(fasta_file);
+  } catch (const runtime_error& e) {
+    cerr << e.what() << endl;
+    return;
+  }
+
+  if (!sequential) {
+    size_t num_ranges = max((size_t) 1, min((size_t) pool.size(), parser->get_size() / PARSE_RANGE_MIN_SIZE));
+    for (size_t i = 0; i < num_ranges; i++) {
+      pool.schedule([this, &out, parser, i, num_ranges] () {
+        MappedFastaParser::Range range(*parser, i, num_ranges);
+        FastaRecordView record;
+        while (range.next(record))
+          pool.schedule([this, &out, parser, record] () { count_record(out, record, true); }); // parser keeps the mapping
+      });
+    }
+    if (block) pool.wait();
+    return;
+  }
+
+  FastaRecordView record;
+
+  unique_ptr<long[]> counts; // Reused by every long record
+  KmerCountingSession session(kmer_counter);
+  while (parser->next(record)) {
+    if (!is_dense() || counter_bits != 64 || is_short_record(record.sequence_length)) {
+      count_record(out, record, false);
+      continue;
+    }
+
+    if (!counts) counts.reset(new long[kmer_counter.get_vector_size()]);
+    memset(counts.get(), 0, sizeof(long) * kmer_counter.get_vector_size());
+    session.begin_record(counts.get());
+    for (size_t fed = 0; fed < record.sequence_length; fed += FASTA_BLOCK_SIZE)
+      session.feed(record.sequence + fed, min(FASTA_BLOCK_SIZE, record.sequence_length - fed));
+    uint64_t skipped_bases = session.end_record();
+    write_counts(out, record_header(record.header_string(), skipped_bases), counts.get(), kmer_counter.get_kmer_length());
+  }
+}
+
+/**
+ * Private method: count_record
+ * ----------------------------
+ * Counts one record of a mapped file with the sparse, short, narrow or dense backend and writes its counts
+ * @param out: Stream to output k-mer counts to
+ * @param record: The record to count
+ * @param parallel: True to count long records on several threads at once (see count_dense)
+ */
+void AsyncKmerCounter::count_record(ostream& out, const FastaRecordView& record, bool parallel) {
+  const string header = record.header_string();
+  const string sequence = record.sequence_string();
+  if (!is_dense()) {
+    auto counts = count_sparse(sequence);
+    write_sparse_counts(out, record_header(header), counts);
+    return;
+  }
+  if (is_short_record(sequence.size())) {
+    auto kmers = count_short(sequence);
+    write_short_counts(out, record_header(header), kmers);
+    return;
+  }
+  if (counter_bits == 8) return count_narrow_record<uint8_t>(out, header, sequence);
+  if (counter_bits == 16) return count_narrow_record<uint16_t>(out, header, sequence);
+  if (counter_bits == 32) return count_narrow_record<uint32_t>(out, header, sequence);
+
+  vector<long> counts(kmer_counter.get_vector_size());
+  uint64_t skipped_bases;
+  if (parallel) skipped_bases = count_dense(sequence, counts.data());
+  else {
+    kmer_counter.count(sequence, counts.data());
+    skipped_bases = KmerCounter::get_skipped_bases();
+  }
+  write_counts(out, record_header(header, skipped_bases), counts.data(), kmer_counter.get_kmer_length());
+}
+
+/*
+ * Counting into dense vectors of narrow counters, which saturate and spill into a side
+ * table. Each thread's vector is a quarter to an eighth of the size of a vector of longs.
+ */
+template<typename Counter>
+void AsyncKmerCounter::count_narrow_record(ostream& out, const string& header, const string& sequence) {
+  SaturatingCounts<Counter> counts(kmer_counter.get_vector_size());
+  kmer_counter.count(sequence, counts);
+
+  write_counts(out, record_header(header), counts, kmer_counter.get_kmer_length());
+}
+
+template<typename Counter>
+void AsyncKmerCounter::count_narrow_sequential(istream &in, ostream &out) {
+  SaturatingCounts<Counter> counts(kmer_counter.get_vector_size());
+
+  FastaParser parser(&in);
+  for (auto it = parser.begin(); it != parser.end(); ++it) {
+    const string& sequence = it->second;
+    if (is_short_record(sequence.size())) {
+      auto kmers = count_short(sequence);
+      write_short_counts(out, record_header(parser.parse_header(it->first)), kmers);
+      continue;
+    }
+
+    counts.clear();
+    kmer_counter.count(sequence, counts);
+    write_counts(out, record_header(parser.parse_header(it->first)), counts, kmer_counter.get_kmer_length());
+  }
+}
+
+template<typename Counter>
+void AsyncKmerCounter::count_narrow_async(istream &in, ostream &out, bool block) {
+  FastaParser parser(&in);
+  for (auto it = parser.begin(); it != parser.end(); ++it) {
+    shared_ptr<pair<string, string>> record = *it;
+
+    pool.schedule([&, record] () {
+      const string& sequence = record->second;
+      if (is_short_record(sequence.size())) {
+        auto kmers = count_short(sequence);
+        write_short_counts(out, record_header(parser.parse_header(record->first)), kmers);
+        return;
+      }
+
+      SaturatingCounts<Counter> counts(kmer_counter.get_vector_size());
+      kmer_counter.count(sequence, counts);
+
+      write_counts(out, record_header(parser.parse_header(record->first)), counts, kmer_counter.get_kmer_length());
+    });
+  }
+  if (block) pool.wait();
+}
+
+/*
+ * Counting every k-mer length in a range at once. The vectors of counts of each length are laid
+ * out one after another in a single allocation, shortest first, and each record is parsed and
+ * translated only once.
+ */
+void AsyncKmerCounter::count_range_sequential(istream &in, ostream &out) {
+  vector<long> counts(kmer_counter.get_range_vector_size());
+
+  FastaParser parser(&in);
+  for (auto it = parser.begin(); it != parser.end(); ++it) {
+    fill(counts.begin(), counts.end(), 0);
+    count_range(it->second, counts.data());
+    write_range_counts(out, record_header(parser.parse_header(it->first)), counts.data());
+  }
+}
+
+void AsyncKmerCounter::count_range_async(istream &in, ostream &out, bool block) {
+  FastaParser parser(&in);
+  for (auto it = parser.begin(); it != parser.end(); ++it) {
+    shared_ptr<pair<string, string>> record = *it;
+
+    pool.schedule([&, record] () {
+      vector<long> counts(kmer_counter.get_range_vector_size());
+      count_range(record->second, counts.data());
+
+      write_range_counts(out, record_header(parser.parse_header(record->first)), counts.data());
+    });
+  }
+  if (block) pool.wait();
+}
+
+/*
+ * Out-of-core counting. Records are split into super-k-mers and spilled to bucket files as they are
+ * parsed, then the buckets are counted and their counts merged into a single line for the whole input.
+ * Every bucket is counted before the output is locked. Plain counts are then merged from disk straight
+ * to the output, since they may be too many to hold in memory. A bucket file which can't be created,
+ * written or read back throws, since the counts would otherwise be silently incomplete.
+ */
+void AsyncKmerCounter::count_partitioned(istream &in, ostream &out, bool parallel) {
+  unique_ptr<DiskPartitionedCounter> partitioned(
+    new DiskPartitionedCounter(kmer_counter, pool, disk_buckets, temp_directory));
+
+  string header;
+  FastaParser parser(&in);
+  for (auto it = parser.begin(); it != parser.end(); ++it) {
+    if (header.empty()) header = parser.parse_header(it->first);
+    partitioned->add(it->second);
+  }
+  if (header.empty()) return;
+  partitioned->count_buckets(parallel);
+
+  if (top_kmers > 0) {
+    // The least of the most frequent k-mers so far is at the top of the heap
+    auto worse = [] (const pair<kmer_code_t, long>& a, const pair<kmer_code_t, long>& b) {
+      return a.second > b.second || (a.second == b.second && a.first < b.first);
+    };
+    priority_queue<pair<kmer_code_t, long>, vector<pair<kmer_code_t, long>>, decltype(worse)> top(worse);
+    partitioned->collect([&] (uint64_t code, long count) {
+      top.emplace(code, count);
+      if (top.size() > top_kmers) top.pop();
+    });
+    vector<pair<kmer_code_t, long>> kmers;
+    for (; !top.empty(); top.pop()) kmers.push_back(top.top());
+    reverse(kmers.begin(), kmers.end());
+    out << oslock;
+    write_kmers(out, header, kmers);
+    out << osunlock;
+    return;
+  }
+
+  if (spectrum) {
+    KmerSpectrum file_spectrum;
+    partitioned->collect([&file_spectrum] (uint64_t, long count) { file_spectrum.add(count); });
+    out << oslock;
+    write_spectrum(out, header, file_spectrum);
+    out << osunlock;
+    return;
+  }
+
+  out << oslock;
+  try {
+    out << header;
+    partitioned->collect([&] (uint64_t code, long count) {
+      out << ", " << kmer_counter.kmer_string(code) << ":" << count;
+    });
+    out << endl;
+  } catch (...) {
+    out << osunlock;
+    throw;
+  }
+  out << osunlock;
+}
+
+/*
+ * Approximate counting. Records are added to the file's sketch concurrently, and the sketch is only
+ * written once every record has been added.
+ */
+void AsyncKmerCounter::count_sketch(istream &in, ostream &out, bool parallel) {
+  auto file_sketch = make_shared<CountMinSketch>(sketch_width, sketch_depth, sketch == "conservative");
+
+  FastaParser parser(&in);
+  for (auto it = parser.begin(); it != parser.end(); ++it) {
+    shared_ptr<pair<string, string>> record = *it;
+    auto add_record = [this, record, file_sketch] () {
+      kmer_counter.for_each_kmer(record->second, [&file_sketch] (kmer_code_t code) {
+        file_sketch->add((uint64_t) code);
+      });
+    };
+    if (parallel) pool.schedule(add_record);
+    else add_record();
+  }
+  if (parallel) pool.wait();
+
+  out << oslock;
+  file_sketch->save(out);
+  out << osunlock;
+}
+
+/*
+ * Cardinality estimation. Each record is sketched on its own thread, then merged into the sketch of
+ * its file when summing, and into the sketch of everything counted.
+ */
+void AsyncKmerCounter::count_cardinality(istream &in, ostream &out, bool parallel, bool block) {
+  auto file_sketch = make_shared<HyperLogLog>(cardinality_precision);
+  auto file_sketch_lock = make_shared<mutex>();
+  string header;
+
+  FastaParser parser(&in);
+  for (auto it = parser.begin(); it != parser.end(); ++it) {
+    shared_ptr<pair<string, string>> record = *it;
+    if (sum_files && header.empty()) header = parser.parse_header(record->first);
+
+    auto sketch_record = [&, record, file_sketch, file_sketch_lock] () {
+      HyperLogLog record_sketch(cardinality_precision);
+      kmer_counter.for_each_kmer(record->second, [&record_sketch] (kmer_code_t code) {
+        record_sketch.add((uint64_t) code);
+      });
+      {
+        lock_guard<mutex> lock(all_kmers_lock);
+        all_kmers.merge(record_sketch);
+      }
+
+      if (sum_files) {
+        lock_guard<mutex> lock(*file_sketch_lock);
+        file_sketch->merge(record_sketch);
+        return;
+      }
+      out << oslock;
+      out << record_header(parser.parse_header(record->first)) << ", " << record_sketch.estimate() << endl;
+      out << osunlock;
+    };
+    if (parallel) pool.schedule(sketch_record);
+    else sketch_record();
+  }
+  if (!sum_files) {
+    if (parallel && block) pool.wait();
+    return;
+  }
+
+  if (parallel) pool.wait(); // The file's sketch is only complete once every record has been sketched
+  if (header.empty()) return;
+  out << oslock;
+  out << header << ", " << file_sketch->estimate() << endl;
+  out << osunlock;
+}
+
+/*
+ * Streaming heavy hitters. Each record is streamed through a Space-Saving summary on a pool thread. When
+ * summing, records stream through whichever of the file's summaries is idle, so there are only ever as
+ * many summaries as records being counted at once, and they are merged once the whole file has been read.
+ */
+void AsyncKmerCounter::count_heavy_hitters(istream &in, ostream &out, bool parallel, bool block) {
+  struct FileSummaries {
+    mutex lock;
+    vector<unique_ptr<SpaceSaving>> idle;
+  };
+  auto summaries = make_shared<FileSummaries>();
+  string header;
+
+  FastaParser parser(&in);
+  for (auto it = parser.begin(); it != parser.end(); ++it) {
+    shared_ptr<pair<string, string>> record = *it;
+    if (sum_files && header.empty()) header = parser.parse_header(record->first);
+
+    auto summarize_record = [&, record, summaries] () {
+      unique_ptr<SpaceSaving> summary;
+      if (sum_files) {
+        lock_guard<mutex> lock(summaries->lock);
+        if (!summaries->idle.empty()) {
+          summary = move(summaries->idle.back());
+          summaries->idle.pop_back();
+        }
+      }
+      if (!summary) summary.reset(new SpaceSaving(space_saving));
+      SpaceSaving& s = *summary;
+      kmer_counter.for_each_kmer(record->second, [&s] (kmer_code_t code) { s.add((uint64_t) code); });
+
+      if (sum_files) {
+        lock_guard<mutex> lock(summaries->lock);
+        summaries->idle.push_back(move(summary));
+        return;
+      }
+      auto top = s.top(top_kmers);
+      out << oslock;
+      write_kmers(out, record_header(parser.parse_header(record->first)), vector<pair<kmer_code_t, long>>(top.begin(), top.end()));
+      out << osunlock;
+    };
+    if (parallel) pool.schedule(summarize_record);
+    else summarize_record();
+  }
+  if (!sum_files) {
+    if (parallel && block) pool.wait();
+    return;
+  }
+
+  if (parallel) pool.wait(); // The file's summaries are only complete once every record has been streamed through
+  if (header.empty()) return;
+  SpaceSaving& file_summary = *summaries->idle.front();
+  for (size_t i = 1; i < summaries->idle.size(); i++) file_summary.merge(*summaries->idle[i]);
+  auto top = file_summary.top(top_kmers);
+  out << oslock;
+  write_kmers(out, header, vector<pair<kmer_code_t, long>>(top.begin(), top.end()));
+  out << osunlock;
+}
+
+/*
+ * Counting with a singleton filter. The first pass adds k-mers to the table only once the filter has
+ * seen them, so each count in the table is one short of the true count, except for k-mers which were
+ * false positives of the filter the first time they were seen. Without a second pass, one is added to
+ * every count. The second pass recounts every k-mer in the table from zero, and those false positives
+ * which occur only once are dropped.
+ */
+void AsyncKmerCounter::count_filtered(istream &in, ostream &out, bool parallel) {
+  // Only k-mers seen at least twice are added, of which there are at most half as many as bases
+  uint64_t bases = stream_size(in);
+  ConcurrentKmerTable table(bases > 0 ? table_capacity(bases / 2) : CONCURRENT_TABLE_INITIAL_CAPACITY);
+  string header;
+  {
+    BloomFilter filter(bloom_bytes);
+    header = count_pass(in, parallel, [&filter, &table] (kmer_code_t code) {
+      if (filter.insert((uint64_t) code)) table.increment((uint64_t) code);
+    });
+  }
+  if (header.empty()) return;
+
+  long correction = 1;
+  if (bloom_exact) {
+    in.clear();
+    if (!in.seekg(0)) {
+      cerr << "Exact counting with a Bloom filter requires input which can be read twice" << endl;
+      return;
+    }
+    table.reset_counts();
+    count_pass(in, parallel, [&table] (kmer_code_t code) { table.increment_existing((uint64_t) code); });
+    correction = 0;
+  }
+
+  vector<pair<kmer_code_t, long>> counts;
+  for (auto& kmer : table.collect()) {
+    if (kmer.second + correction >= 2) counts.emplace_back(kmer.first, kmer.second + correction);
+  }
+  write_sparse_counts(out, header, counts);
+}
+
+/**
+ * Private method: count_pass
+ * --------------------------
+ * Calls visit with the code of every k-mer of every record in a stream
+ * @param in: Stream to read fasta records from
+ * @param parallel: True to visit records on the pool, in which case visit is called from several threads
+ * @param visit: Callable taking the kmer_code_t code of each k-mer
+ * @return: The header of the first record, or empty if there were no records
+ */
+string AsyncKmerCounter::count_pass(istream &in, bool parallel, const function<void(kmer_code_t)>& visit) {
+  string header;
+  FastaParser parser(&in);
+  for (auto it = parser.begin(); it != parser.end(); ++it) {
+    shared_ptr<pair<string, string>> record = *it;
+    if (header.empty()) header = parser.parse_header(record->first);
+    auto count_record = [this, record, &visit] () { kmer_counter.for_each_kmer(record->second, visit); };
+    if (parallel) pool.schedule(count_record);
+    else count_record();
+  }
+  if (parallel) pool.wait();
+  return header;
+}
+
+/*
+ * Counting by sorting. Each record's k-mer codes are collected into a KmerSorter whose buffer is
+ * bounded by the memory budget. When summing files every record is sorted into runs of its own, and
+ * the runs of each record are merged into those of the file.
+ */
+void AsyncKmerCounter::count_sorted_sequential(istream &in, ostream &out) {
+  auto sorter = make_sorter(SIZE_MAX);
+  string header;
+
+  FastaParser parser(&in);
+  for (auto it = parser.begin(); it != parser.end(); ++it) {
+    if (!sum_files) sorter->clear();
+    kmer_counter.for_each_kmer(it->second, [&sorter] (kmer_code_t code) { sorter->add((uint64_t) code); });
+    if (!sum_files) write_sparse_counts(out, record_header(parser.parse_header(it->first)), sorted_kmers(*sorter));
+    else if (header.empty()) header = parser.parse_header(it->first);
+  }
+  if (sum_files && !header.empty()) write_sparse_counts(out, header, sorted_kmers(*sorter));
+}
+
+void AsyncKmerCounter::count_sorted_async(istream &in, ostream &out, bool block) {
+  auto file_runs = make_shared<vector<pair<uint64_t, long>>>();
+  auto file_runs_lock = make_shared<mutex>();
+  string header;
+
+  FastaParser parser(&in);
+  for (auto it = parser.begin(); it != parser.end(); ++it) {
+    shared_ptr<pair<string, string>> record = *it;
+    if (sum_files && header.empty()) header = parser.parse_header(record->first);
+
+    pool.schedule([&, record, file_runs, file_runs_lock] () {
+      const string& sequence = record->second;
+      auto sorter = make_sorter(sequence.size());
+      kmer_counter.for_each_kmer(sequence, [&sorter] (kmer_code_t code) { sorter->add((uint64_t) code); });
+
+      if (sum_files) {
+        auto runs = sorter->collect();
+        lock_guard<mutex> lock(*file_runs_lock);
+        *file_runs = KmerSorter::merge_runs(*file_runs, runs);
+        return;
+      }
+      auto counts = sorted_kmers(*sorter);
+      write_sparse_counts(out, record_header(parser.parse_header(record->first)), counts);
+    });
+  }
+  if (!sum_files) {
+    if (block) pool.wait();
+    return;
+  }
+
+  pool.wait(); // The sum is only complete once every record has been counted
+  if (header.empty()) return;
+  write_sparse_counts(out, header, vector<pair<kmer_code_t, long>>(file_runs->begin(), file_runs->end()));
+}
+
+/**
+ * Private method: make_sorter
+ * ---------------------------
+ * Creates a sorter for the current k-mer length whose buffer fits in the memory budget
+ * @param max_codes: An upper bound on the number of codes that will be added
+ * @return: The sorter
+ */
+unique_ptr<KmerSorter> AsyncKmerCounter::make_sorter(size_t max_codes) {
+  uint64_t budget_codes = kmer_counter.get_memory_budget() / sizeof(uint64_t);
+  size_t buffer_size = (size_t) min((uint64_t) max_codes, budget_codes);
+
+  // Codes are less than the number of unique k-mers, if that fits in 64 bits
+  uint64_t vector_size = kmer_counter.get_vector_size();
+  unsigned int key_bits = vector_size <= 1 ? 64 : 64 - __builtin_clzll(vector_size - 1);
+  return unique_ptr<KmerSorter>(new KmerSorter(pool, buffer_size, key_bits));
+}
+
+/*
+ * When a dense vector of counts would exceed the memory budget, k-mers are counted into a
+ * lock-free ConcurrentKmerTable holding only those k-mers which occur (or a SparseKmerCounts
+ * map if k-mer indices are wider than 64 bits). When summing files, the k-mers of every record
+ * are counted into a single table which all of the pool's threads insert into at once. Maps are
+ * not safe to insert into at once, so with wide indices each record is counted into a map of its
+ * own, which is then added into the file's map under a lock.
+ */
+void AsyncKmerCounter::count_sparse_sequential(istream &in, ostream &out) {
+  FastaParser parser(&in);
+  if (sum_files && kmer_counter.has_64_bit_index()) {
+    uint64_t bases = stream_size(in);
+    ConcurrentKmerTable table(bases > 0 ? table_capacity(bases) : CONCURRENT_TABLE_INITIAL_CAPACITY);
+    string header;
+    for (auto it = parser.begin(); it != parser.end(); ++it) {
+      if (header.empty()) header = parser.parse_header(it->first);
+      kmer_counter.count(it->second, table);
+    }
+    if (!header.empty()) write_sparse_counts(out, header, sorted_kmers(table));
+    return;
+  }
+  if (sum_files) {
+    SparseKmerCounts counts;
+    string header;
+    for (auto it = parser.begin(); it != parser.end(); ++it) {
+      if (header.empty()) header = parser.parse_header(it->first);
+      kmer_counter.count(it->second, counts);
+    }
+    if (!header.empty()) write_sparse_counts(out, header, sorted_kmers(counts));
+    return;
+  }
+
+  for (auto it = parser.begin(); it != parser.end(); ++it) {
+    auto counts = count_sparse(it->second);
+    write_sparse_counts(out, record_header(parser.parse_header(it->first)), counts);
+  }
+}
+
+void AsyncKmerCounter::count_sparse_async(istream &in, ostream &out, bool block) {
+  FastaParser parser(&in);
+  if (sum_files && kmer_counter.has_64_bit_index()) {
+    uint64_t bases = stream_size(in);
+    auto table = make_shared<ConcurrentKmerTable>(bases > 0 ? table_capacity(bases) : CONCURRENT_TABLE_INITIAL_CAPACITY);
+    string header;
+    for (auto it = parser.begin(); it != parser.end(); ++it) {
+      shared_ptr<pair<string, string>> record = *it;
+      if (header.empty()) header = parser.parse_header(record->first);
+      pool.schedule([this, record, table] () { kmer_counter.count(record->second, *table); });
+    }
+    pool.wait(); // The sum is only complete once every record has been counted
+    if (header.empty()) return;
+    write_sparse_counts(out, header, sorted_kmers(*table));
+    return;
+  }
+  if (sum_files) {
+    auto file_counts = make_shared<SparseKmerCounts>();
+    auto file_counts_lock = make_shared<mutex>();
+    string header;
+    for (auto it = parser.begin(); it != parser.end(); ++it) {
+      shared_ptr<pair<string, string>> record = *it;
+      if (header.empty()) header = parser.parse_header(record->first);
+      pool.schedule([this, record, file_counts, file_counts_lock] () {
+        SparseKmerCounts counts;
+        kmer_counter.count(record->second, counts);
+        lock_guard<mutex> lock(*file_counts_lock);
+        for (auto& kmer : counts) (*file_counts)[kmer.first] += kmer.second;
+      });
+    }
+    pool.wait();
+    if (header.empty()) return;
+    write_sparse_counts(out, header, sorted_kmers(*file_counts));
+    return;
+  }
+
+  for (auto it = parser.begin(); it != parser.end(); ++it) {
+    shared_ptr<pair<string, string>> record = *it;
+
+    pool.schedule([&, record] () {
+      auto counts = count_sparse(record->second);
+
+      write_sparse_counts(out, record_header(parser.parse_header(record->first)), counts);
+    });
+  }
+  if (block) pool.wait();
+}
+
+/**
+ * Private method: table_capacity
+ * ------------------------------
+ * Sizes the first generation of a ConcurrentKmerTable to hold a number of distinct k-mers below its
+ * load factor, so that it need not grow. There are no more distinct k-mers than k-mers of this
+ * length, and since the capacity is rounded up to a power of two, it is capped at half the memory
+ * budget; the table grows from there if it must.
+ * @param max_kmers: The most distinct k-mers the table may have to hold
+ * @return: Number of slots for the first generation of the table
+ */
+size_t AsyncKmerCounter::table_capacity(uint64_t max_kmers) const {
+  if (kmer_counter.get_vector_size() > 0) max_kmers = min(max_kmers, kmer_counter.get_vector_size());
+  uint64_t max_slots = kmer_counter.get_memory_budget() / (sizeof(uint64_t) + sizeof(long)) / 2;
+  return (size_t) min(max_kmers + max_kmers / 2, max_slots);
+}
+
+/**
+ * Private method: stream_size
+ * ---------------------------
+ * Measures the input left to read, which bounds the number of bases in it, leaving the stream where
+ * it was
+ * @param in: The input stream
+ * @return: Number of bytes left in the stream, or zero if it cannot be seeked (such as a pipe)
+ */
+uint64_t AsyncKmerCounter::stream_size(istream& in) {
+  streampos start = in.tellg();
+  if (start == streampos(-1)) return 0;
+  if (!in.seekg(0, ios::end)) {
+    in.clear();
+    return 0;
+  }
+  streampos end = in.tellg();
+  in.seekg(start);
+  return end > start ? (uint64_t) (end - start) : 0;
+}
+
+/**
+ * Private method: count_sparse
+ * ----------------------------
+ * Counts the k-mers of one sequence with the sparse backend
+ * @param sequence: The sequence to count k-mers in
+ * @return: (index, count) pairs for the k-mers which occur, in lexicographic order
+ */
+vector<pair<kmer_code_t, long>> AsyncKmerCounter::count_sparse(const string& sequence) {
+  if (kmer_counter.has_64_bit_index()) {
+    // There are no more distinct k-mers than positions in the sequence
+    ConcurrentKmerTable table(table_capacity(sequence.size()));
+    kmer_counter.count(sequence, table);
+    return sorted_kmers(table);
+  }
+
+  SparseKmerCounts counts;
+  kmer_counter.count(sequence, counts);
+  return sorted_kmers(counts);
+}
+
+// The contents of a map as (index, count) pairs in lexicographic order
+vector<pair<kmer_code_t, long>> AsyncKmerCounter::sorted_kmers(const SparseKmerCounts& counts) {
+  vector<pair<kmer_code_t, long>> kmers(counts.begin(), counts.end());
+  sort(kmers.begin(), kmers.end(), [] (const pair<kmer_code_t, long>& a, const pair<kmer_code_t, long>& b) {
+    return a.first < b.first;
+  });
+  return kmers;
+}
+
+// The contents of a table as (index, count) pairs in lexicographic order
+vector<pair<kmer_code_t, long>> AsyncKmerCounter::sorted_kmers(const ConcurrentKmerTable& table) {
+  auto kmers = table.collect();
+  return vector<pair<kmer_code_t, long>>(kmers.begin(), kmers.end());
+}
+
+// The contents of a sorter as (index, count) pairs in lexicographic order
+vector<pair<kmer_code_t, long>> AsyncKmerCounter::sorted_kmers(KmerSorter& sorter) {
+  auto kmers = sorter.collect();
+  return vector<pair<kmer_code_t, long>>(kmers.begin(), kmers.end());
+}
+
 void AsyncKmerCounter::count_fasta_file(const string &fastaFile, ostream &out, bool sequential, bool block) {
   if (!boost::filesystem::exists(fastaFile)) return; // File not found
+  if (counts_records_alone() && MappedFastaParser::is_mappable(fastaFile))
+    return count_mapped(fastaFile, out, sequential, block);
   ifstream is(fastaFile);
   count(is, out, sequential, block);
 }
@@ -73,17 +897,388 @@ void AsyncKmerCounter::count_fasta_file(const string &fastaFile, ostream &out, b
 void AsyncKmerCounter::count_directory(const string &directory, ostream &out, bool sequential, bool block) {
   if (!boost::filesystem::exists(directory)) return;
 
+  // The first error counting a file on the pool, thrown once every file is done if blocking
+  auto error = make_shared<pair<mutex, exception_ptr>>();
   boost::filesystem::directory_iterator end;
   for (boost::filesystem::directory_iterator it(directory); it != end; ++it) {
     if (boost::filesystem::is_regular_file(it->path())) {
       string file_name = it->path().generic_string();
       if (sequential) count_fasta_file(file_name, out, sequential, true);
-      else pool.schedule([&, file_name] () {
-          count_fasta_file(file_name, out, true, true);
+      else pool.schedule([&, file_name, error, block] () {
+          try {
+            count_fasta_file(file_name, out, true, true);
+          } catch (const runtime_error& e) {
+            lock_guard<mutex> lock(error->first);
+            if (!block) cerr << e.what() << endl;
+            else if (!error->second) error->second = current_exception();
+          }
       });
     }
   }
-  if (!sequential && block) pool.wait();
+  if (!sequential && block) {
+    pool.wait();
+    if (error->second) rethrow_exception(error->second);
+  }
+}
+
+/**
+ * Private method: write_counts
+ * ----------------------------
+ * Writes one line of k-mer counts to the output stream, taking the stream's lock only once the spectrum
+ * or the most frequent k-mers have been found, if that is what is output. In canonical mode the slots of
+ * non-canonical k-mers are always zero and are left out of the output.
+ * @param out: Stream to output k-mer counts to
+ * @param header: Header of the record that was counted
+ * @param counts: The k-mer counts of the record, indexable by k-mer index
+ * @param kmer_length: The length of the k-mers that were counted
+ */
+template<typename Counts>
+void AsyncKmerCounter::write_counts(ostream& out, const string& header, const Counts& counts, unsigned int kmer_length) {
+  if (top_kmers > 0 || spectrum) return write_lines(out, summary_line(header, counts, kmer_length));
+
+  out << oslock;
+  write_dense_counts(out, header, counts, kmer_length);
+  out << osunlock;
+}
+
+/**
+ * Private method: write_dense_counts
+ * ----------------------------------
+ * Writes one line of every count in a dense vector to a stream which is already locked (see write_counts)
+ */
+template<typename Counts>
+void AsyncKmerCounter::write_dense_counts(ostream& out, const string& header, const Counts& counts,
+                                          unsigned int kmer_length) {
+  out << header;
+  for (size_t i = 0; i < kmer_counter.get_vector_size(kmer_length); i++)
+    if (kmer_counter.is_canonical_index(i, kmer_length)) out << ", " << counts[i];
+  out << endl;
+}
+
+/**
+ * Private method: summary_line
+ * ----------------------------
+ * Finds the most frequent k-mers or the spectrum of a dense vector of counts on the thread pool, without
+ * holding the output stream's lock
+ * @param header: Header of the record that was counted
+ * @param counts: The k-mer counts of the record, indexable by k-mer index
+ * @param kmer_length: The length of the k-mers that were counted
+ * @return: The line of output, newline included
+ */
+template<typename Counts>
+string AsyncKmerCounter::summary_line(const string& header, const Counts& counts, unsigned int kmer_length) {
+  ostringstream line;
+  if (top_kmers > 0) {
+    auto kmer_at = [&] (uint64_t i) {
+      return make_pair((kmer_code_t) i, kmer_counter.is_canonical_index(i, kmer_length) ? (long) counts[i] : 0);
+    };
+    write_kmers(line, header, top_of(kmer_counter.get_vector_size(kmer_length), kmer_at));
+  } else {
+    auto count_at = [&] (uint64_t i) { return kmer_counter.is_canonical_index(i, kmer_length) ? (long) counts[i] : 0; };
+    write_spectrum(line, header, spectrum_of(kmer_counter.get_vector_size(kmer_length), count_at));
+  }
+  return line.str();
+}
+
+/**
+ * Private method: write_lines
+ * ---------------------------
+ * Writes lines formatted beforehand to the output stream, holding its lock only while writing them
+ * @param out: Stream to output the lines to
+ * @param lines: The lines, each ending with a newline
+ */
+void AsyncKmerCounter::write_lines(ostream& out, const string& lines) {
+  out << oslock;
+  out << lines << flush;
+  out << osunlock;
+}
+
+/**
+ * Private method: write_short_counts
+ * ----------------------------------
+ * Writes the counts of a short record (see count_short) exactly as write_counts would have written
+ * them from a dense vector
+ * @param out: Stream to output k-mer counts to
+ * @param header: Header of the record that was counted
+ * @param counts: (index, count) pairs for the k-mers which occur, in lexicographic order
+ */
+void AsyncKmerCounter::write_short_counts(ostream& out, const string& header,
+                                          const vector<pair<kmer_code_t, long>>& counts) {
+  if (top_kmers > 0) {
+    vector<pair<kmer_code_t, long>> top(counts);
+    size_t n = min(top_kmers, top.size());
+    partial_sort(top.begin(), top.begin() + n, top.end(), [] (const pair<kmer_code_t, long>& a, const pair<kmer_code_t, long>& b) {
+      return a.second > b.second || (a.second == b.second && a.first < b.first);
+    });
+    top.resize(n);
+    ostringstream line;
+    write_kmers(line, header, top);
+    return write_lines(out, line.str());
+  }
+  if (spectrum) {
+    KmerSpectrum record_spectrum;
+    for (auto& kmer : counts) record_spectrum.add(kmer.second);
+    ostringstream line;
+    write_spectrum(line, header, record_spectrum);
+    return write_lines(out, line.str());
+  }
+
+  out << oslock;
+  out << header;
+  uint64_t next = 0;
+  for (auto& kmer : counts) {
+    write_zeros(out, next, (uint64_t) kmer.first);
+    out << ", " << kmer.second;
+    next = (uint64_t) kmer.first + 1;
+  }
+  write_zeros(out, next, kmer_counter.get_vector_size());
+  out << endl;
+  out << osunlock;
+}
+
+/**
+ * Private method: write_zeros
+ * ---------------------------
+ * Writes a zero count for every canonical k-mer index in a range, a block of zeros at a time unless
+ * counting canonical k-mers
+ * @param out: Stream to output k-mer counts to
+ * @param begin: First index in the range
+ * @param end: Index one past the end of the range
+ */
+void AsyncKmerCounter::write_zeros(ostream& out, uint64_t begin, uint64_t end) {
+  if (kmer_counter.counting_canonical()) {
+    for (uint64_t i = begin; i < end; i++)
+      if (kmer_counter.is_canonical_index(i)) out << ", 0";
+    return;
+  }
+
+  static const string zeros = [] () {
+    string block;
+    for (int i = 0; i < 4096; i++) block += ", 0";
+    return block;
+  }();
+  const uint64_t block_size = zeros.size() / 3;
+  for (; begin + block_size <= end; begin += block_size) out.write(zeros.data(), zeros.size());
+  out.write(zeros.data(), (streamsize) (3 * (end - begin)));
+}
+
+/**
+ * Private method: count_range
+ * ---------------------------
+ * Counts k-mers of every length in the range in one sequence
+ * @param sequence: The sequence to count k-mers in
+ * @param counts: get_range_vector_size() zeroed counts, holding the vector of each length, shortest first
+ */
+void AsyncKmerCounter::count_range(const string& sequence, long counts[]) {
+  vector<long*> vectors;
+  for (unsigned int k = kmer_counter.get_min_kmer_length(); k <= kmer_counter.get_kmer_length(); k++) {
+    vectors.push_back(counts);
+    counts += kmer_counter.get_vector_size(k);
+  }
+  kmer_counter.count_range(sequence, vectors.data());
+}
+
+/**
+ * Private method: write_range_counts
+ * ----------------------------------
+ * Writes the block of lines of k-mer counts of one record, one line per k-mer length, all at once
+ * @param out: Stream to output k-mer counts to
+ * @param header: Header of the record that was counted
+ * @param counts: The vector of counts of each length, shortest first (see count_range)
+ */
+void AsyncKmerCounter::write_range_counts(ostream& out, const string& header, const long counts[]) {
+  if (top_kmers > 0 || spectrum) {
+    string lines;
+    for (unsigned int k = kmer_counter.get_min_kmer_length(); k <= kmer_counter.get_kmer_length(); k++) {
+      lines += summary_line(header + " k=" + to_string(k), counts, k);
+      counts += kmer_counter.get_vector_size(k);
+    }
+    return write_lines(out, lines);
+  }
+
+  out << oslock;
+  for (unsigned int k = kmer_counter.get_min_kmer_length(); k <= kmer_counter.get_kmer_length(); k++) {
+    write_dense_counts(out, header + " k=" + to_string(k), counts, k);
+    counts += kmer_counter.get_vector_size(k);
+  }
+  out << osunlock;
+}
+
+/**
+ * Private method: record_header
+ * -----------------------------
+ * Gives the header to output for a record that was just counted by the calling thread
+ * @param header: Header of the record
+ * @return: The header, with " skipped=<bases>" appended if reporting skipped bases
+ */
+string AsyncKmerCounter::record_header(const string& header) const {
+  return record_header(header, KmerCounter::get_skipped_bases());
+}
+
+string AsyncKmerCounter::record_header(const string& header, uint64_t skipped_bases) const {
+  if (!report_skipped) return header;
+  return header + " skipped=" + to_string(skipped_bases);
+}
+
+/**
+ * Private method: write_sparse_counts
+ * -----------------------------------
+ * Writes one line of sparse k-mer counts to the output stream, as "k-mer:count" pairs, taking the
+ * stream's lock only once the spectrum or the most frequent k-mers have been found
+ * @param out: Stream to output k-mer counts to
+ * @param header: Header of the record that was counted
+ * @param counts: (index, count) pairs of the k-mers in the record, in lexicographic order
+ */
+void AsyncKmerCounter::write_sparse_counts(ostream& out, const string& header,
+                                           const vector<pair<kmer_code_t, long>>& counts) {
+  ostringstream line;
+  if (top_kmers > 0) write_kmers(line, header, top_of(counts.size(), [&counts] (uint64_t i) { return counts[i]; }));
+  else if (spectrum)
+    write_spectrum(line, header, spectrum_of(counts.size(), [&counts] (uint64_t i) { return counts[i].second; }));
+  if (top_kmers > 0 || spectrum) return write_lines(out, line.str());
+
+  out << oslock;
+  write_kmers(out, header, counts);
+  out << osunlock;
+}
+
+/**
+ * Private method: write_kmers
+ * ---------------------------
+ * Writes one line of (k-mer, count) pairs to a stream which is already locked (or only used by this
+ * thread), as "k-mer:count" pairs in the order given
+ * @param out: Stream to output k-mer counts to
+ * @param header: Header of the record that was counted
+ * @param counts: (index, count) pairs of k-mers
+ */
+void AsyncKmerCounter::write_kmers(ostream& out, const string& header, const vector<pair<kmer_code_t, long>>& counts) {
+  out << header;
+  for (auto& kmer : counts) out << ", " << kmer_counter.kmer_string(kmer.first) << ":" << kmer.second;
+  out << endl;
+}
+
+/**
+ * Private method: top_of
+ * ----------------------
+ * Selects the most frequent k-mers from a set of counts. Each task keeps the top_kmers most frequent
+ * k-mers of a chunk of SPECTRUM_CHUNK_SIZE counts in a heap, and the chunks' selections are merged.
+ * @param size: The number of counts
+ * @param kmer_at: Callable giving the (kmer_code_t code, long count) pair at each index from 0 to size - 1
+ * @return: The top_kmers k-mers of greatest count, in decreasing order of count then increasing order of
+ * code. K-mers with a count of zero are never selected.
+ */
+template<typename KmerAt>
+vector<pair<kmer_code_t, long>> AsyncKmerCounter::top_of(uint64_t size, KmerAt kmer_at) {
+  auto better = [] (const pair<kmer_code_t, long>& a, const pair<kmer_code_t, long>& b) {
+    return a.second > b.second || (a.second == b.second && a.first < b.first);
+  };
+  vector<pair<kmer_code_t, long>> selected;
+  mutex selected_lock;
+
+  size_t num_chunks = (size_t) ((size + SPECTRUM_CHUNK_SIZE - 1) / SPECTRUM_CHUNK_SIZE);
+  parallel_for(pool, num_chunks, [&] (size_t chunk) {
+    // The least of the chunk's selection is at the top of the heap
+    priority_queue<pair<kmer_code_t, long>, vector<pair<kmer_code_t, long>>, decltype(better)> top(better);
+    uint64_t end = min(size, (uint64_t) (chunk + 1) * SPECTRUM_CHUNK_SIZE);
+    for (uint64_t i = (uint64_t) chunk * SPECTRUM_CHUNK_SIZE; i < end; i++) {
+      pair<kmer_code_t, long> kmer = kmer_at(i);
+      if (kmer.second <= 0) continue;
+      if (top.size() < top_kmers) top.push(kmer);
+      else if (better(kmer, top.top())) {
+        top.pop();
+        top.push(kmer);
+      }
+    }
+    lock_guard<mutex> lock(selected_lock);
+    for (; !top.empty(); top.pop()) selected.push_back(top.top());
+  });
+
+  size_t n = min(top_kmers, selected.size());
+  partial_sort(selected.begin(), selected.begin() + n, selected.end(), better);
+  selected.resize(n);
+  return selected;
+}
+
+/**
+ * Private method: spectrum_of
+ * ---------------------------
+ * Tallies a set of counts into a k-mer spectrum, a chunk of SPECTRUM_CHUNK_SIZE counts per task
+ * @param size: The number of counts
+ * @param count_at: Callable giving the long count at each index from 0 to size - 1
+ * @return: The spectrum of the counts
+ */
+template<typename CountAt>
+KmerSpectrum AsyncKmerCounter::spectrum_of(uint64_t size, CountAt count_at) {
+  KmerSpectrum total;
+  mutex total_lock;
+  size_t num_chunks = (size_t) ((size + SPECTRUM_CHUNK_SIZE - 1) / SPECTRUM_CHUNK_SIZE);
+  parallel_for(pool, num_chunks, [&] (size_t chunk) {
+    KmerSpectrum partial;
+    uint64_t end = min(size, (uint64_t) (chunk + 1) * SPECTRUM_CHUNK_SIZE);
+    for (uint64_t i = (uint64_t) chunk * SPECTRUM_CHUNK_SIZE; i < end; i++) partial.add(count_at(i));
+    lock_guard<mutex> lock(total_lock);
+    total.merge(partial);
+  });
+  return total;
+}
+
+/**
+ * Private method: write_spectrum
+ * ------------------------------
+ * Writes one line of a k-mer spectrum to the output stream, as "count:k-mers" pairs
+ * @param out: Stream to output the spectrum to
+ * @param header: Header of the record (or file) that was counted
+ * @param spectrum: The spectrum of its counts
+ */
+void AsyncKmerCounter::write_spectrum(ostream& out, const string& header, const KmerSpectrum& spectrum) {
+  out << header;
+  spectrum.for_each([&out] (long count, uint64_t kmers) { out << ", " << count << ":" << kmers; });
+  out << endl;
+}
+
+void AsyncKmerCounter::validate() const {
+  if (counter_bits != 8 && counter_bits != 16 && counter_bits != 32 && counter_bits != 64)
+    throw invalid_argument("Counters must be 8, 16, 32 or 64 bits, not " + to_string(counter_bits));
+  kmer_counter.validate();
+  if (sorting && !kmer_counter.has_64_bit_index())
+    throw invalid_argument("Counting k-mers by sorting requires k-mer codes that fit in 64 bits");
+  if (disk_buckets > 0 && !sum_files)
+    throw invalid_argument("Out-of-core counting sums the counts of each file, and requires --sum");
+  if (disk_buckets > 0 && (!kmer_counter.has_64_bit_index() || kmer_counter.counting_range()))
+    throw invalid_argument("Out-of-core counting requires a single k-mer length with codes that fit in 64 bits");
+  if (!sketch.empty() && sketch != "countmin" && sketch != "conservative")
+    throw invalid_argument("Unknown sketch \"" + sketch + "\", expected countmin or conservative");
+  if (cardinality_precision > 0 && (cardinality_precision < HLL_MIN_PRECISION || cardinality_precision > HLL_MAX_PRECISION))
+    throw invalid_argument("HyperLogLog precision must be from " + to_string(HLL_MIN_PRECISION) + " to " +
+                           to_string(HLL_MAX_PRECISION));
+  if (cardinality_precision > 0 && (!sketch.empty() || sorting || disk_buckets > 0))
+    throw invalid_argument("Cardinality estimation can't be combined with sketching, sorting or counting out of core");
+  if (cardinality_precision > 0 && (!kmer_counter.has_64_bit_index() || kmer_counter.counting_range()))
+    throw invalid_argument("Cardinality estimation requires a single k-mer length with codes that fit in 64 bits");
+  if (space_saving > 0 && (top_kmers == 0 || space_saving < top_kmers))
+    throw invalid_argument("Space-Saving needs --top, and at least as many counters as k-mers to output");
+  if (space_saving > 0 && (!kmer_counter.has_64_bit_index() || kmer_counter.counting_range()))
+    throw invalid_argument("Space-Saving requires a single k-mer length with codes that fit in 64 bits");
+  if (space_saving > 0 && (sorting || disk_buckets > 0 || bloom_bytes > 0))
+    throw invalid_argument("Space-Saving replaces exact counting, and can't be combined with sorting, "
+                           "counting out of core or the Bloom filter");
+  if (top_kmers > 0 && (spectrum || cardinality_precision > 0 || !sketch.empty()))
+    throw invalid_argument("The most frequent k-mers can't be output with the spectrum or a sketch");
+  if (spectrum && (cardinality_precision > 0 || !sketch.empty()))
+    throw invalid_argument("The k-mer spectrum requires exact counts, not a sketch");
+  if (bloom_bytes > 0 && (!sum_files || !kmer_counter.has_64_bit_index() || kmer_counter.counting_range()))
+    throw invalid_argument("The Bloom filter requires --sum and a single k-mer length with codes that fit in 64 bits");
+  if (bloom_bytes > 0 && (cardinality_precision > 0 || !sketch.empty() || sorting || disk_buckets > 0))
+    throw invalid_argument("The Bloom filter only applies to exact counting in memory");
+  if (!sketch.empty() && (sorting || disk_buckets > 0))
+    throw invalid_argument("Sketching can't be combined with counting by sorting or out of core");
+  if (!sketch.empty() && (!kmer_counter.has_64_bit_index() || kmer_counter.counting_range()))
+    throw invalid_argument("Sketching requires a single k-mer length with codes that fit in 64 bits");
+  if (sorting && kmer_counter.counting_range())
+    throw invalid_argument("Counting k-mers by sorting does not support a range of k-mer lengths");
+  if (kmer_counter.counting_range() && (counter_bits != 64 || !is_dense()))
+    throw invalid_argument("Counting a range of k-mer lengths requires 64-bit counters and dense vectors of "
+                           "counts that fit in the memory budget together");
 }
 
 AsyncKmerCounter::~AsyncKmerCounter() {
@@ -223,6 +223,14 @@ void BatchProcessor::schedule_key(const string &key) {
   schedule_cv.notify_one(); // Notify potentially waiting thread of scheduling
 }
 
+bool BatchProcessor::reduce_max(uint8_t data[], size_t length) {
+  vector<uint8_t> result(length);
+  MPI_Reduce(data, result.data(), (int) length, MPI_UNSIGNED_CHAR, MPI_MAX, BP_HEAD_NODE, MPI_COMM_WORLD);
+  if (world_rank != BP_HEAD_NODE) return false;
+  copy(result.begin(), result.end(), data);
+  return true;
+}
+
 bool BatchProcessor::scheduling_completed() {
   lock_guard<mutex> lg(scheduling_complete_mutex);
   return scheduling_complete;
@@ -0,0 +1,16 @@
+/**
+ * File: bloom-filter.cpp
+ * ----------------------
+ * Presents the implementation of BloomFilter
+ */
+
+#include "bloom-filter.hpp"
+using namespace std;
+
+BloomFilter::BloomFilter(size_t bytes) {
+  size_t num_words = 1;
+  while (num_words * sizeof(uint64_t) < bytes) num_words <<= 1;
+  word_mask = num_words - 1;
+  words.reset(new atomic<uint64_t>[num_words]);
+  for (size_t i = 0; i < num_words; i++) words[i].store(0, memory_order_relaxed);
+}
@@ -0,0 +1,267 @@
+/**
+ * File: concurrent-kmer-table.cpp
+ * -------------------------------
+ * Presents the implementation of ConcurrentKmerTable
+ */
+
+#include "concurrent-kmer-table.hpp"
+#include "mix64.hpp"
+#include <algorithm>
+#include <limits>
+using namespace std;
+
+// Marks slots which have not been claimed by any key
+static const uint64_t empty_key = ~((uint64_t) 0);
+
+// Marks empty slots of a full generation sealed during its migration, so that nothing claims them
+static const uint64_t moved_key = empty_key - 1;
+
+// Seals the count of a claimed slot once it has been moved: adding to it leaves it negative
+static const long moved_count = numeric_limits<long>::min();
+
+// Generations are grown when this fraction of their slots are claimed
+#define MAX_LOAD_NUMERATOR 7
+#define MAX_LOAD_DENOMINATOR 10
+
+ConcurrentKmerTable::Generation::Generation(size_t capacity) :
+  capacity(capacity), max_used(capacity / MAX_LOAD_DENOMINATOR * MAX_LOAD_NUMERATOR),
+  num_slices((capacity + MIGRATION_SLICE - 1) / MIGRATION_SLICE), slots(new Slot[capacity]), used(0),
+  next(nullptr), next_slice(0), slices_moved(0) {
+  for (size_t i = 0; i < capacity; i++) {
+    slots[i].key.store(empty_key, memory_order_relaxed);
+    slots[i].count.store(0, memory_order_relaxed);
+  }
+}
+
+ConcurrentKmerTable::ConcurrentKmerTable(size_t initial_capacity) {
+  size_t capacity = 1;
+  while (capacity < initial_capacity || capacity < MAX_LOAD_DENOMINATOR) capacity <<= 1;
+  first = new Generation(capacity);
+  oldest.store(first);
+  current.store(first);
+  for (int i = 0; i < 2; i++) {
+    marker_counts[i].store(0);
+    has_marker[i].store(false);
+  }
+}
+
+/*
+ * The codes of the slot markers cannot be keys, so their k-mers are counted on the side.
+ */
+void ConcurrentKmerTable::increment(uint64_t code, long amount) {
+  if (code >= moved_key) {
+    has_marker[code - moved_key].store(true, memory_order_relaxed);
+    marker_counts[code - moved_key].fetch_add(amount, memory_order_relaxed);
+    return;
+  }
+  add(current.load(memory_order_acquire), code, amount);
+}
+
+/*
+ * A k-mer whose slot has been sealed is in the table, but its count is on its way to the next
+ * generation, so the amount is added there instead.
+ */
+bool ConcurrentKmerTable::increment_existing(uint64_t code, long amount) {
+  if (code >= moved_key) {
+    if (!has_marker[code - moved_key].load(memory_order_relaxed)) return false;
+    marker_counts[code - moved_key].fetch_add(amount, memory_order_relaxed);
+    return true;
+  }
+
+  for (Generation* g = oldest.load(memory_order_acquire); g != nullptr; g = g->next.load(memory_order_acquire)) {
+    Slot* existing = find(g, code);
+    if (existing == nullptr) continue;
+    if (existing->count.fetch_add(amount, memory_order_relaxed) < 0) add(grow(g), code, amount);
+    return true;
+  }
+  return false;
+}
+
+void ConcurrentKmerTable::reset_counts() {
+  for (Generation* g = oldest.load(); g != nullptr; g = g->next.load())
+    for (size_t i = 0; i < g->capacity; i++)
+      if (g->slots[i].count.load(memory_order_relaxed) > 0) g->slots[i].count.store(0, memory_order_relaxed);
+  for (int i = 0; i < 2; i++) marker_counts[i].store(0);
+}
+
+/**
+ * Private method: add
+ * -------------------
+ * Adds to the count of a k-mer, claiming a slot for it if it has none, starting from a given
+ * generation and following on to the next whenever that one is full or the k-mer's slot is sealed
+ * @param generation: The generation to begin in
+ * @param code: The 64-bit code of the k-mer, which is not a slot marker
+ * @param amount: The amount to add to its count
+ */
+void ConcurrentKmerTable::add(Generation* generation, uint64_t code, long amount) {
+  while (true) {
+    Slot* slot = claim(generation, code);
+    if (slot != nullptr && slot->count.fetch_add(amount, memory_order_relaxed) >= 0) return;
+    generation = grow(generation);
+  }
+}
+
+/**
+ * Private method: claim
+ * ---------------------
+ * Gives the slot of a k-mer in a generation, claiming an empty one for it if it has none and the
+ * generation is neither full nor being moved. Since keys are never removed and sealed empty slots
+ * are never claimed, reaching either means the k-mer has no slot further along.
+ * @param generation: The generation to search
+ * @param code: The 64-bit code of the k-mer
+ * @return: The k-mer's slot (whose count may be sealed), or null if it cannot be given a slot here
+ */
+ConcurrentKmerTable::Slot* ConcurrentKmerTable::claim(Generation* generation, uint64_t code) {
+  size_t mask = generation->capacity - 1;
+  size_t i = mix64(code) & mask;
+  for (size_t probe = 0; probe < generation->capacity; probe++, i = (i + 1) & mask) {
+    Slot& slot = generation->slots[i];
+    uint64_t key = slot.key.load(memory_order_acquire);
+    if (key == empty_key) {
+      if (generation->next.load(memory_order_acquire) != nullptr) return nullptr;
+      if (generation->used.load(memory_order_relaxed) >= generation->max_used) return nullptr;
+      if (slot.key.compare_exchange_strong(key, code, memory_order_acq_rel)) {
+        generation->used.fetch_add(1, memory_order_relaxed);
+        return &slot;
+      }
+    }
+    if (key == code) return &slot;
+    if (key == moved_key) return nullptr;
+  }
+  return nullptr;
+}
+
+/**
+ * Private method: find
+ * --------------------
+ * @param generation: The generation to search
+ * @param code: The 64-bit code of a k-mer
+ * @return: The k-mer's slot in the generation, or null if it has not been added to the generation
+ */
+ConcurrentKmerTable::Slot* ConcurrentKmerTable::find(Generation* generation, uint64_t code) {
+  size_t mask = generation->capacity - 1;
+  size_t i = mix64(code) & mask;
+  for (size_t probe = 0; probe < generation->capacity; probe++, i = (i + 1) & mask) {
+    uint64_t key = generation->slots[i].key.load(memory_order_acquire);
+    if (key == empty_key || key == moved_key) break;
+    if (key == code) return &generation->slots[i];
+  }
+  return nullptr;
+}
+
+/**
+ * Private method: grow
+ * --------------------
+ * Gives the generation after a full one, creating it if no other thread has yet, and helps move the
+ * full generation's keys into it until every slice has been taken by some thread
+ * @param full: A generation which is full or being moved
+ * @return: The next generation
+ */
+ConcurrentKmerTable::Generation* ConcurrentKmerTable::grow(Generation* full) {
+  Generation* next = full->next.load(memory_order_acquire);
+  if (next == nullptr) {
+    auto fresh = new Generation(full->capacity * 2);
+    if (full->next.compare_exchange_strong(next, fresh, memory_order_acq_rel)) next = fresh;
+    else {
+      delete[] fresh->slots; // Another thread linked its generation first
+      delete fresh;
+    }
+  }
+  Generation* expected = full;
+  current.compare_exchange_strong(expected, next, memory_order_acq_rel);
+
+  while (full->next_slice.load(memory_order_relaxed) < full->num_slices) {
+    size_t slice = full->next_slice.fetch_add(1, memory_order_relaxed);
+    if (slice >= full->num_slices) break;
+    move_slice(full, slice);
+    if (full->slices_moved.fetch_add(1, memory_order_acq_rel) + 1 == full->num_slices) retire();
+  }
+  return next;
+}
+
+/**
+ * Private method: move_slice
+ * --------------------------
+ * Moves the keys in one slice of a full generation into the next generation, sealing every slot
+ * so that threads still using the full generation follow on to the next. A k-mer is added to the
+ * next generation even when its count is zero, so that it stays in the table.
+ * @param full: A generation whose next generation has been linked
+ * @param slice: Index of the slice of MIGRATION_SLICE slots to move
+ */
+void ConcurrentKmerTable::move_slice(Generation* full, size_t slice) {
+  Generation* next = full->next.load(memory_order_acquire);
+  size_t end = min(full->capacity, (slice + 1) * MIGRATION_SLICE);
+  for (size_t i = slice * MIGRATION_SLICE; i < end; i++) {
+    Slot& slot = full->slots[i];
+    uint64_t key = empty_key;
+    if (slot.key.compare_exchange_strong(key, moved_key, memory_order_acq_rel)) continue;
+    long count = slot.count.exchange(moved_count, memory_order_acq_rel);
+    add(next, key, count);
+  }
+}
+
+/**
+ * Private method: retire
+ * ----------------------
+ * Stops searching the oldest generations once every one of their slices has been moved. Retired
+ * generations may still be read by threads which loaded them earlier, so they are only freed when
+ * the table is destroyed.
+ */
+void ConcurrentKmerTable::retire() {
+  Generation* g = oldest.load(memory_order_acquire);
+  while (g->next.load(memory_order_acquire) != nullptr &&
+         g->slices_moved.load(memory_order_acquire) == g->num_slices) {
+    Generation* next = g->next.load(memory_order_acquire);
+    if (!oldest.compare_exchange_strong(g, next, memory_order_acq_rel)) continue; // g is now the oldest
+    g = next;
+  }
+}
+
+/*
+ * Slots not yet moved out of a generation are only left over if collect is called while other threads
+ * are still incrementing; their counts are summed with those of the same k-mer in later generations.
+ */
+vector<pair<uint64_t, long>> ConcurrentKmerTable::collect() const {
+  vector<pair<uint64_t, long>> kmers;
+  for (Generation* g = oldest.load(); g != nullptr; g = g->next.load()) {
+    for (size_t i = 0; i < g->capacity; i++) {
+      uint64_t key = g->slots[i].key.load(memory_order_relaxed);
+      long count = g->slots[i].count.load(memory_order_relaxed);
+      if (key != empty_key && key != moved_key && count >= 0) kmers.emplace_back(key, count);
+    }
+  }
+  sort(kmers.begin(), kmers.end());
+
+  size_t merged = 0;
+  for (size_t i = 0; i < kmers.size(); i++) {
+    if (merged > 0 && kmers[merged - 1].first == kmers[i].first) kmers[merged - 1].second += kmers[i].second;
+    else kmers[merged++] = kmers[i];
+  }
+  kmers.resize(merged);
+
+  for (int i = 0; i < 2; i++)
+    if (has_marker[i].load()) kmers.emplace_back(moved_key + i, marker_counts[i].load());
+  return kmers;
+}
+
+size_t ConcurrentKmerTable::capacity() const {
+  size_t total = 0;
+  for (Generation* g = oldest.load(); g != nullptr; g = g->next.load()) total += g->capacity;
+  return total;
+}
+
+size_t ConcurrentKmerTable::generations() const {
+  size_t total = 0;
+  for (Generation* g = oldest.load(); g != nullptr; g = g->next.load()) total++;
+  return total;
+}
+
+ConcurrentKmerTable::~ConcurrentKmerTable() {
+  Generation* g = first;
+  while (g != nullptr) {
+    Generation* next = g->next.load();
+    delete[] g->slots;
+    delete g;
+    g = next;
+  }
+}
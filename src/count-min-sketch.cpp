@@ -0,0 +1,129 @@
+/**
+ * File: count-min-sketch.cpp
+ * --------------------------
+ * Presents the implementation of CountMinSketch
+ */
+
+#include "count-min-sketch.hpp"
+#include "mix64.hpp"
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+using namespace std;
+
+static const char sketch_magic[8] = {'K', 'M', 'E', 'R', 'C', 'M', 'S', '1'};
+#define SKETCH_FLAG_CONSERVATIVE 1
+
+CountMinSketch::CountMinSketch(size_t width, unsigned int depth, bool conservative) :
+  width(1), depth(max(depth, 1u)), conservative(conservative), total(0) {
+  while (this->width < width) this->width <<= 1;
+  size_t size = this->width * this->depth;
+  counters.reset(new atomic<uint32_t>[size]);
+  for (size_t i = 0; i < size; i++) counters[i].store(0, memory_order_relaxed);
+}
+
+/*
+ * Conservative update raises each of the k-mer's counters to one more than its current estimate,
+ * unless another thread has already raised it that far. Counters are never lowered, so estimates
+ * remain upper bounds when threads race.
+ */
+void CountMinSketch::add(uint64_t code) {
+  total.fetch_add(1, memory_order_relaxed);
+  uint64_t h = mix64(code);
+  if (!conservative) {
+    for (unsigned int row = 0; row < depth; row++) {
+      atomic<uint32_t>& counter = counters[slot(h, row)];
+      if (counter.load(memory_order_relaxed) != numeric_limits<uint32_t>::max())
+        counter.fetch_add(1, memory_order_relaxed);
+    }
+    return;
+  }
+
+  uint32_t least = numeric_limits<uint32_t>::max();
+  for (unsigned int row = 0; row < depth; row++)
+    least = min(least, counters[slot(h, row)].load(memory_order_relaxed));
+  if (least == numeric_limits<uint32_t>::max()) return;
+  for (unsigned int row = 0; row < depth; row++) {
+    atomic<uint32_t>& counter = counters[slot(h, row)];
+    uint32_t value = counter.load(memory_order_relaxed);
+    while (value <= least && !counter.compare_exchange_weak(value, least + 1, memory_order_relaxed));
+  }
+}
+
+uint32_t CountMinSketch::estimate(uint64_t code) const {
+  uint64_t h = mix64(code);
+  uint32_t least = numeric_limits<uint32_t>::max();
+  for (unsigned int row = 0; row < depth; row++)
+    least = min(least, counters[slot(h, row)].load(memory_order_relaxed));
+  return least;
+}
+
+void CountMinSketch::merge(const CountMinSketch& other) {
+  if (other.width != width || other.depth != depth)
+    throw invalid_argument("Cannot merge Count-Min sketches of different dimensions");
+  for (size_t i = 0; i < width * depth; i++) {
+    uint64_t sum = (uint64_t) counters[i].load(memory_order_relaxed) + other.counters[i].load(memory_order_relaxed);
+    counters[i].store((uint32_t) min(sum, (uint64_t) numeric_limits<uint32_t>::max()), memory_order_relaxed);
+  }
+  total.fetch_add(other.get_total(), memory_order_relaxed);
+}
+
+void CountMinSketch::save(ostream& out) const {
+  uint64_t width_field = width;
+  uint32_t depth_field = depth;
+  uint32_t flags = conservative ? SKETCH_FLAG_CONSERVATIVE : 0;
+  uint64_t total_field = get_total();
+  out.write(sketch_magic, sizeof(sketch_magic));
+  out.write((const char*) &width_field, sizeof(width_field));
+  out.write((const char*) &depth_field, sizeof(depth_field));
+  out.write((const char*) &flags, sizeof(flags));
+  out.write((const char*) &total_field, sizeof(total_field));
+
+  // Counters are copied out a row at a time, since atomics need not share the layout of uint32_t
+  vector<uint32_t> row(width);
+  for (unsigned int r = 0; r < depth; r++) {
+    for (size_t i = 0; i < width; i++) row[i] = counters[r * width + i].load(memory_order_relaxed);
+    out.write((const char*) row.data(), sizeof(uint32_t) * width);
+  }
+}
+
+unique_ptr<CountMinSketch> CountMinSketch::load(istream& in) {
+  char magic[sizeof(sketch_magic)];
+  uint64_t width_field, total_field;
+  uint32_t depth_field, flags;
+  in.read(magic, sizeof(magic));
+  in.read((char*) &width_field, sizeof(width_field));
+  in.read((char*) &depth_field, sizeof(depth_field));
+  in.read((char*) &flags, sizeof(flags));
+  in.read((char*) &total_field, sizeof(total_field));
+  if (!in || memcmp(magic, sketch_magic, sizeof(magic)) != 0)
+    throw runtime_error("Not a serialized Count-Min sketch");
+  if (width_field == 0 || (width_field & (width_field - 1)) != 0 || depth_field == 0)
+    throw runtime_error("Invalid Count-Min sketch dimensions");
+
+  unique_ptr<CountMinSketch> sketch(new CountMinSketch((size_t) width_field, depth_field,
+                                                       (flags & SKETCH_FLAG_CONSERVATIVE) != 0));
+  vector<uint32_t> row(sketch->width);
+  for (unsigned int r = 0; r < sketch->depth; r++) {
+    if (!in.read((char*) row.data(), sizeof(uint32_t) * sketch->width))
+      throw runtime_error("Truncated Count-Min sketch");
+    for (size_t i = 0; i < sketch->width; i++) sketch->counters[r * sketch->width + i].store(row[i], memory_order_relaxed);
+  }
+  sketch->total.store(total_field, memory_order_relaxed);
+  return sketch;
+}
+
+/**
+ * Private method: slot
+ * --------------------
+ * Chooses the counter of a k-mer in one row by double hashing: row r uses h1 + r * h2, where h1 is the
+ * hash and h2 is the hash with its halves swapped, made odd so that it is never zero
+ * @param hash: Hash of the k-mer's code
+ * @param row: The row
+ * @return: Position of the counter in counters
+ */
+size_t CountMinSketch::slot(uint64_t hash, unsigned int row) const {
+  uint64_t step = ((hash << 32) | (hash >> 32)) | 1;
+  return row * width + (size_t) ((hash + row * step) & (width - 1));
+}
@@ -0,0 +1,149 @@
+/**
+ * File: disk-partitioned-counter.cpp
+ * ----------------------------------
+ * Presents the implementation of DiskPartitionedCounter
+ */
+
+#include "disk-partitioned-counter.hpp"
+#include "parallel-for.hpp"
+#include <boost/filesystem.hpp>
+#include <exception>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+using namespace std;
+
+DiskPartitionedCounter::DiskPartitionedCounter(KmerCounter& kmer_counter, boost::threadpool::pool& pool,
+                                               size_t num_buckets, const string& directory) :
+  kmer_counter(kmer_counter), pool(pool) {
+  boost::filesystem::path parent = directory.empty() ? boost::filesystem::temp_directory_path() : directory;
+  boost::filesystem::path path = parent / boost::filesystem::unique_path("kmer-buckets-%%%%-%%%%-%%%%");
+  boost::system::error_code error;
+  boost::filesystem::create_directories(path, error);
+  if (error) throw runtime_error("Could not create bucket directory " + path.string() + ": " + error.message());
+  this->directory = path.string();
+
+  for (size_t i = 0; i < max(num_buckets, (size_t) 1); i++) {
+    buckets.emplace_back(new ofstream(bucket_path(i), ios::binary));
+    if (!*buckets.back()) {
+      buckets.clear();
+      boost::filesystem::remove_all(path, error);
+      throw runtime_error("Could not create bucket file " + bucket_path(i));
+    }
+  }
+}
+
+void DiskPartitionedCounter::add(const string& sequence) {
+  kmer_counter.for_each_super_kmer(sequence, [this, &sequence] (size_t start, size_t end, uint64_t minimizer) {
+    ofstream& bucket = *buckets[minimizer % buckets.size()];
+    uint32_t length = (uint32_t) (end - start);
+    bucket.write((const char*) &length, sizeof(length));
+    bucket.write(sequence.data() + start, length);
+    if (bucket.fail()) throw runtime_error("Could not write bucket file " + bucket_path(minimizer % buckets.size()));
+  });
+}
+
+void DiskPartitionedCounter::count_buckets(bool parallel) {
+  for (size_t i = 0; i < buckets.size(); i++) {
+    buckets[i]->close(); // Flushes whatever is still buffered
+    if (buckets[i]->fail()) throw runtime_error("Could not write bucket file " + bucket_path(i));
+  }
+  if (!parallel) {
+    for (size_t i = 0; i < buckets.size(); i++) count_bucket(i);
+    return;
+  }
+
+  // An error counting a bucket on the pool is thrown from here once every bucket is done
+  exception_ptr error;
+  mutex error_lock;
+  parallel_for(pool, buckets.size(), [&] (size_t i) {
+    try {
+      count_bucket(i);
+    } catch (const runtime_error&) {
+      lock_guard<mutex> lock(error_lock);
+      if (!error) error = current_exception();
+    }
+  });
+  if (error) rethrow_exception(error);
+}
+
+void DiskPartitionedCounter::collect(const function<void(uint64_t, long)>& visit) {
+  // Merge the sorted counts of every bucket. Buckets hold disjoint k-mers, but counts are summed anyway.
+  vector<unique_ptr<ifstream>> counts;
+  typedef pair<uint64_t, size_t> Head; // Next code in a bucket, and the bucket
+  priority_queue<Head, vector<Head>, greater<Head>> heads;
+  vector<long> head_counts(buckets.size());
+
+  auto advance = [&] (size_t i) {
+    uint64_t code;
+    if (counts[i]->read((char*) &code, sizeof(code)) && counts[i]->read((char*) &head_counts[i], sizeof(long)))
+      heads.emplace(code, i);
+    else if (counts[i]->gcount() != 0 || !counts[i]->eof()) throw runtime_error("Could not read " + counts_path(i));
+  };
+  for (size_t i = 0; i < buckets.size(); i++) {
+    counts.emplace_back(new ifstream(counts_path(i), ios::binary));
+    if (!*counts.back()) throw runtime_error("Could not open " + counts_path(i));
+    advance(i);
+  }
+
+  while (!heads.empty()) {
+    uint64_t code = heads.top().first;
+    long count = 0;
+    while (!heads.empty() && heads.top().first == code) {
+      size_t i = heads.top().second;
+      heads.pop();
+      count += head_counts[i];
+      advance(i);
+    }
+    visit(code, count);
+  }
+}
+
+/**
+ * Private method: count_bucket
+ * ----------------------------
+ * Counts the k-mers of the super-k-mers in one bucket file in memory, and replaces the bucket file with
+ * a file of (code, count) pairs sorted by code
+ * @param bucket: Number of the bucket
+ * @throws std::runtime_error: If the bucket file can't be read in full or its counts can't be written
+ */
+void DiskPartitionedCounter::count_bucket(size_t bucket) {
+  boost::system::error_code error;
+  uint64_t size = boost::filesystem::file_size(bucket_path(bucket), error);
+  if (error) throw runtime_error("Could not read bucket file " + bucket_path(bucket) + ": " + error.message());
+  ConcurrentKmerTable table((size_t) size); // Bytes bound k-mers
+  {
+    ifstream in(bucket_path(bucket), ios::binary);
+    string super_kmer;
+    uint32_t length;
+    while (in.read((char*) &length, sizeof(length))) {
+      super_kmer.resize(length);
+      if (!in.read(&super_kmer[0], length)) break;
+      kmer_counter.count(super_kmer, table);
+    }
+    if (!in.eof() || in.gcount() != 0) throw runtime_error("Could not read bucket file " + bucket_path(bucket));
+  }
+  boost::filesystem::remove(bucket_path(bucket));
+
+  ofstream out(counts_path(bucket), ios::binary);
+  for (auto& kmer : table.collect()) {
+    out.write((const char*) &kmer.first, sizeof(kmer.first));
+    out.write((const char*) &kmer.second, sizeof(kmer.second));
+  }
+  out.close();
+  if (out.fail()) throw runtime_error("Could not write " + counts_path(bucket));
+}
+
+string DiskPartitionedCounter::bucket_path(size_t bucket) const {
+  return directory + "/bucket-" + to_string(bucket);
+}
+
+string DiskPartitionedCounter::counts_path(size_t bucket) const {
+  return directory + "/counts-" + to_string(bucket);
+}
+
+DiskPartitionedCounter::~DiskPartitionedCounter() {
+  buckets.clear();
+  boost::system::error_code error;
+  boost::filesystem::remove_all(directory, error);
+}
@@ -8,12 +8,14 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
+#include <stdexcept>
 
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 using namespace std;
 
 #define K_DEFAULT 4
+#define MEMORY_BUDGET_DEFAULT 4096
 #define DNA_SYMBOLS "ATGC"
 #define NUM_THREADS 8
 
@@ -27,8 +29,30 @@ DistributedKmerCounter::DistributedKmerCounter(int* argcp, char*** argvp) :
   out_stream_p = make_shared<ofstream>(s.str());
 
   counter.set_kmer_length(kmer_length);
+  counter.set_min_kmer_length(min_kmer_length);
   counter.set_symbols(symbols);
+  counter.set_spaced_seed(spaced_seed);
   counter.set_sum_files(sum_files);
+  counter.set_canonical(canonical);
+  counter.set_partitioned(partitioned);
+  counter.set_sorting(sorting);
+  counter.set_disk_buckets(disk_buckets);
+  counter.set_temp_directory(temp_directory);
+  counter.set_sketch(sketch, sketch_width, sketch_depth);
+  if (cardinality) counter.set_cardinality(hll_precision);
+  counter.set_bloom_filter(((size_t) bloom_filter) << 20, bloom_exact);
+  counter.set_spectrum(spectrum);
+  counter.set_top_kmers(top_kmers, space_saving);
+  counter.set_memory_budget(((uint64_t) memory_budget) << 20);
+  counter.set_counter_bits(counter_bits);
+  counter.set_report_skipped(report_skipped);
+
+  try {
+    counter.validate();
+  } catch (const invalid_argument& e) {
+    cerr << e.what() << endl;
+    exit(1);
+  }
 
   processor.init_logger(verbose, debug);
 }
@@ -44,6 +68,15 @@ void DistributedKmerCounter::run() {
     );
 
   processor.wait();
+
+  // The union of every rank's sketch is written by the head node
+  if (cardinality) {
+    HyperLogLog all_kmers = counter.cardinality_sketch();
+    if (!processor.reduce_max(all_kmers.data(), all_kmers.get_size())) return;
+    ofstream sketch_out(hll_output.empty() ? output_file + ".hll" : hll_output, ios::binary);
+    all_kmers.save(sketch_out);
+    *out_stream_p << "all, " << all_kmers.estimate() << endl;
+  }
 }
 
 // File scheduling
@@ -68,7 +101,12 @@ void DistributedKmerCounter::schedule_files() {
  * @return: The result of counting the file
  */
 void DistributedKmerCounter::count_kmers(const string &file) {
-  counter.count_fasta_file(file, *out_stream_p, true, true);
+  try {
+    counter.count_fasta_file(file, *out_stream_p, true, true);
+  } catch (const runtime_error& e) {
+    cerr << e.what() << endl;
+    exit(1);
+  }
 }
 
 /**
@@ -96,8 +134,29 @@ void DistributedKmerCounter::parse_CLI_options(int argc, const char *const *argv
   config.add_options()
     ("regex,r",   po::value<string>(&fre)->default_value(".*"),      "file pattern regular expression")
     ("k,k",       po::value<size_t>(&kmer_length)->default_value(K_DEFAULT), "k-mer size (i.e. \"k\")")
+    ("seed",      po::value<string>(&spaced_seed)->default_value(""), "spaced seed such as 1101011 selecting the symbols of each k-mer")
+    ("min-k",     po::value<size_t>(&min_kmer_length)->default_value(0), "also count every k-mer size from min-k up to k")
     ("symbols,s", po::value<string>(&symbols)->default_value(DNA_SYMBOLS), "symbols to use for counting")
-    ("sum,sum",   po::bool_switch(&sum_files), "sum all k-mer counts per file");
+    ("sum,sum",   po::bool_switch(&sum_files), "sum all k-mer counts per file")
+    ("canonical", po::bool_switch(&canonical), "count k-mers together with their reverse complements")
+    ("sort",      po::bool_switch(&sorting), "count k-mers by radix sorting their codes, output as \"k-mer:count\"")
+    ("disk-buckets", po::value<size_t>(&disk_buckets)->default_value(0), "count out of core in this many minimizer bucket files (with --sum)")
+    ("tmp-dir",   po::value<string>(&temp_directory)->default_value(""), "directory for bucket files (default: system temporary directory)")
+    ("sketch",    po::value<string>(&sketch)->default_value(""), "count approximately into a Count-Min sketch (countmin or conservative)")
+    ("sketch-width", po::value<size_t>(&sketch_width)->default_value(DEFAULT_SKETCH_WIDTH), "counters in each row of the sketch")
+    ("sketch-depth", po::value<unsigned int>(&sketch_depth)->default_value(DEFAULT_SKETCH_DEPTH), "rows (hash functions) in the sketch")
+    ("cardinality", po::bool_switch(&cardinality), "only estimate the number of distinct k-mers, with HyperLogLog")
+    ("hll-precision", po::value<unsigned int>(&hll_precision)->default_value(DEFAULT_HLL_PRECISION), "HyperLogLog register bits (4 to 18)")
+    ("hll-output", po::value<string>(&hll_output)->default_value(""), "file to write the HyperLogLog sketch of every k-mer counted to")
+    ("bloom-filter", po::value<size_t>(&bloom_filter)->default_value(0), "keep k-mers seen once out of the sparse table with a Bloom filter this size (MiB, with --sum)")
+    ("bloom-exact", po::bool_switch(&bloom_exact), "recount k-mers passing the Bloom filter exactly in a second pass")
+    ("spectrum",  po::bool_switch(&spectrum), "output the k-mer spectrum (\"count:k-mers\" pairs) instead of the counts")
+    ("top",       po::value<size_t>(&top_kmers)->default_value(0), "output only the N most frequent k-mers, as \"k-mer:count\"")
+    ("space-saving", po::value<size_t>(&space_saving)->default_value(0), "find the --top k-mers by streaming through this many Space-Saving counters")
+    ("partition", po::bool_switch(&partitioned), "radix-partition k-mers into cache-sized buckets before counting")
+    ("report-skipped", po::bool_switch(&report_skipped), "append the number of invalid bases in each record to its header")
+    ("memory,m",  po::value<size_t>(&memory_budget)->default_value(MEMORY_BUDGET_DEFAULT), "largest dense count vector (MiB)")
+    ("counter-bits", po::value<unsigned int>(&counter_bits)->default_value(64), "bits per dense k-mer counter (8, 16, 32 or 64)");
 
   po::options_description hidden("Hidden");
   hidden.add_options()
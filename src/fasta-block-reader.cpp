@@ -0,0 +1,83 @@
+/**
+ * File: fasta-block-reader.cpp
+ * ----------------------------
+ * Presents the implementation of FastaBlockReader
+ */
+
+#include "fasta-block-reader.hpp"
+#include <cerrno>
+#include <unistd.h>
+using namespace std;
+
+FastaBlockReader::FastaBlockReader(istream* in) :
+  buffers(FASTA_BLOCK_RING, vector<char>(FASTA_BLOCK_SIZE)), lengths(FASTA_BLOCK_RING, 0) {
+  if (in == &cin) fd = STDIN_FILENO;
+  else this->in = in;
+  reader = thread([this] () { read_blocks(); });
+}
+
+FastaBlockReader::FastaBlockReader(int fd) :
+  fd(fd), buffers(FASTA_BLOCK_RING, vector<char>(FASTA_BLOCK_SIZE)), lengths(FASTA_BLOCK_RING, 0) {
+  reader = thread([this] () { read_blocks(); });
+}
+
+FastaBlockReader::~FastaBlockReader() {
+  {
+    lock_guard<mutex> guard(lock);
+    stopping = true;
+  }
+  changed.notify_all();
+  reader.join();
+}
+
+size_t FastaBlockReader::next_block(const char*& block) {
+  unique_lock<mutex> guard(lock);
+  num_released = num_taken;
+  changed.notify_all();
+  changed.wait(guard, [this] () { return num_read > num_taken || finished; });
+  if (num_read == num_taken) return 0;
+
+  size_t slot = num_taken++ % FASTA_BLOCK_RING;
+  block = buffers[slot].data();
+  return lengths[slot];
+}
+
+// Runs on the reader's thread, filling each block of the ring once the parser has released it
+void FastaBlockReader::read_blocks() {
+  while (true) {
+    size_t slot;
+    {
+      unique_lock<mutex> guard(lock);
+      changed.wait(guard, [this] () { return num_read < num_released + FASTA_BLOCK_RING || stopping; });
+      if (stopping) return;
+      slot = num_read % FASTA_BLOCK_RING;
+    }
+
+    size_t length = read_block(buffers[slot].data());
+    lock_guard<mutex> guard(lock);
+    if (length == 0) finished = true;
+    else {
+      lengths[slot] = length;
+      num_read++;
+    }
+    changed.notify_all();
+    if (finished) return;
+  }
+}
+
+// Reads until the block is full or the input ends
+size_t FastaBlockReader::read_block(char* block) {
+  if (in != nullptr) {
+    in->read(block, FASTA_BLOCK_SIZE);
+    return (size_t) in->gcount();
+  }
+
+  size_t length = 0;
+  while (length < FASTA_BLOCK_SIZE) {
+    ssize_t bytes = read(fd, block + length, FASTA_BLOCK_SIZE - length);
+    if (bytes < 0 && errno == EINTR) continue;
+    if (bytes <= 0) break;
+    length += (size_t) bytes;
+  }
+  return length;
+}
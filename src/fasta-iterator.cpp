@@ -5,52 +5,46 @@
  */
 
 #include "fasta-iterator.hpp"
-#include <boost/algorithm/string/predicate.hpp>
 using namespace std;
 
-FastaIterator::FastaIterator(istream* in) : have_next_header(false) {
-  if (in == nullptr) record = nullptr;
-  else {
-    this->in = in;
-    ++(*this); // On construction, the iterator should already have parsed the first record
-  }
+FastaIterator::FastaIterator(shared_ptr<FastaBlockReader> reader) : reader(reader) {
+  if (reader == nullptr) record = nullptr;
+  else ++(*this); // On construction, the iterator should already have parsed the first record
 }
 
 /*
- * Basically just reads in from the stream until the next record or the
- * end of the stream is encountered. If the end of the stream is encountered
- * then the record is set to be a null pointer.
- *
- * Check this out for more optimizations:
- * https://stackoverflow.com/questions/24851291/read-huge-text-file-line-by-line-in-c-with-buffering
+ * Reads the sequence lines of the next record straight out of the reader's blocks, up to the '>' which
+ * begins the next header or the end of the stream. If there are no more records, then the record is
+ * set to be a null pointer.
  */
 FastaIterator& FastaIterator::operator++ () {
-  have_next_header = find_next_header();
-  if (!have_next_header) record = nullptr;
-  else {
-    record = shared_ptr<pair<string, ostringstream>>(new pair<string, ostringstream>());
-    record->first = nextHeader;
+  if (!find_next_header()) {
+    record = nullptr;
+    return *this;
+  }
+  record = make_shared<pair<string, string>>();
+  record->first = nextHeader;
+
+  while (fill()) {
+    if (line_start && block[position] == '>') break;
 
-    string line;
-    while (!in->eof()) {
-      getline(*in, line);
-      if (!boost::starts_with(line, ">")) record->second << line;
-      else {
-        have_next_header = true;
-        nextHeader = line;
-        break;
-      }
+    size_t end = FastaBlockReader::find_header(block, position, block_length);
+    while (position < end) {
+      const char* newline = (const char*) memchr(block + position, '\n', end - position);
+      size_t line_end = newline == nullptr ? end : (size_t) (newline - block);
+      record->second.append(block + position, line_end - position);
+      position = newline == nullptr ? end : line_end + 1;
     }
-    if (in->eof()) have_next_header = false;
+    line_start = block[end - 1] == '\n';
   }
   return *this;
 }
 
-shared_ptr<pair<string, ostringstream>> FastaIterator::operator*() {
+shared_ptr<pair<string, string>> FastaIterator::operator*() {
   return record;
 }
 
-shared_ptr<pair<string, ostringstream>> FastaIterator::operator-> () {
+shared_ptr<pair<string, string>> FastaIterator::operator-> () {
   return record;
 }
 
@@ -69,10 +63,35 @@ bool FastaIterator::operator != (const FastaIterator& other) {
   return !this->operator==(other);
 }
 
+// Moves on to the next block once the current block has been parsed, returning false at the end of the stream
+bool FastaIterator::fill() {
+  if (position < block_length) return true;
+  block_length = reader->next_block(block);
+  position = 0;
+  return block_length > 0;
+}
+
 // Finds the next header in the stream, and stores it in nextHeader
 bool FastaIterator::find_next_header() {
-  if (have_next_header) return true;
-  while (getline(*in, nextHeader))
-    if (boost::starts_with(nextHeader, ">")) return true;
+  while (fill()) {
+    if (!line_start || block[position] != '>') {
+      // Skip the rest of the line
+      const char* newline = (const char*) memchr(block + position, '\n', block_length - position);
+      line_start = newline != nullptr;
+      position = newline == nullptr ? block_length : (size_t) (newline - block) + 1;
+      continue;
+    }
+
+    nextHeader.clear();
+    do {
+      const char* newline = (const char*) memchr(block + position, '\n', block_length - position);
+      size_t end = newline == nullptr ? block_length : (size_t) (newline - block);
+      nextHeader.append(block + position, end - position);
+      position = newline == nullptr ? end : end + 1;
+      if (newline != nullptr) break;
+    } while (fill());
+    line_start = true;
+    return true;
+  }
   return false;
-}
\ No newline at end of file
+}
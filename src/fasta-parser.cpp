@@ -17,10 +17,74 @@ string FastaParser::parse_header(const string &header) {
   return header;
 }
 
+FastaParser::FastaParser(int fd) : fasta_fd(fd), endit(nullptr) {}
+
 FastaIterator FastaParser::begin() {
-  return FastaIterator(fasta_stream);
+  return FastaIterator(get_reader());
 }
 
 FastaIterator FastaParser::end() {
   return endit;
 }
+
+/*
+ * Scans each block for the '>' which begins a header line. Everything up to it (or to the end of the
+ * block) belongs to the sequence of the current record, and is passed on without looking for newlines.
+ */
+void FastaParser::stream(const function<void(const string&)>& begin_record,
+                         const function<void(const char*, size_t)>& feed,
+                         const function<void()>& end_record) {
+  shared_ptr<FastaBlockReader> reader = get_reader();
+  string header;
+  bool in_header = false;    // True while reading a header line
+  bool in_record = false;    // True once the first header has been read
+  bool line_start = true;    // True if the next character begins a line
+
+  const char* data;
+  while (size_t length = reader->next_block(data)) {
+    size_t pos = 0;
+    while (pos < length) {
+      if (in_header) {
+        const char* newline = (const char*) memchr(data + pos, '\n', length - pos);
+        size_t end = newline == nullptr ? length : (size_t) (newline - data);
+        header.append(data + pos, end - pos);
+        if (newline == nullptr) break;
+        pos = end + 1;
+        line_start = true;
+        in_header = false;
+        begin_record(header);
+        in_record = true;
+        continue;
+      }
+
+      if (line_start && data[pos] == '>') {
+        if (in_record) end_record();
+        in_record = false;
+        in_header = true;
+        header.clear();
+        continue;
+      }
+
+      // The sequence runs up to the next '>' at the start of a line
+      size_t end = FastaBlockReader::find_header(data, pos, length);
+      if (in_record) feed(data + pos, end - pos);
+      line_start = data[end - 1] == '\n';
+      pos = end;
+    }
+  }
+
+  if (in_header) {
+    begin_record(header);
+    in_record = true;
+  }
+  if (in_record) end_record();
+}
+
+// The reader is created once parsing begins, and shared by every iterator of the parser
+shared_ptr<FastaBlockReader> FastaParser::get_reader() {
+  if (reader == nullptr) {
+    if (fasta_fd >= 0) reader = make_shared<FastaBlockReader>(fasta_fd);
+    else reader = make_shared<FastaBlockReader>(fasta_stream);
+  }
+  return reader;
+}
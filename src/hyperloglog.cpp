@@ -0,0 +1,72 @@
+/**
+ * File: hyperloglog.cpp
+ * ---------------------
+ * Presents the implementation of HyperLogLog
+ */
+
+#include "hyperloglog.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+using namespace std;
+
+static const char hll_magic[8] = {'K', 'M', 'E', 'R', 'H', 'L', 'L', '1'};
+
+HyperLogLog::HyperLogLog(unsigned int precision) :
+  precision(min(max(precision, (unsigned int) HLL_MIN_PRECISION), (unsigned int) HLL_MAX_PRECISION)),
+  registers(((size_t) 1) << this->precision, 0) { }
+
+/*
+ * The raw estimate of Flajolet et al. is biased upwards for sets of fewer than about 2.5 * 2^precision
+ * k-mers, where linear counting of the empty registers is accurate instead. With 64-bit hashes no
+ * correction is needed for large sets.
+ */
+uint64_t HyperLogLog::estimate() const {
+  const double m = (double) registers.size();
+  double sum = 0;
+  size_t empty = 0;
+  for (uint8_t rank : registers) {
+    sum += ldexp(1.0, -rank);
+    empty += rank == 0;
+  }
+
+  double alpha;
+  if (registers.size() == 16) alpha = 0.673;
+  else if (registers.size() == 32) alpha = 0.697;
+  else if (registers.size() == 64) alpha = 0.709;
+  else alpha = 0.7213 / (1 + 1.079 / m);
+
+  double estimate = alpha * m * m / sum;
+  if (estimate <= 2.5 * m && empty > 0) estimate = m * log(m / (double) empty);
+  return (uint64_t) llround(estimate);
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+  if (other.precision != precision)
+    throw invalid_argument("Cannot merge HyperLogLog sketches of different precisions");
+  for (size_t i = 0; i < registers.size(); i++) registers[i] = max(registers[i], other.registers[i]);
+}
+
+void HyperLogLog::save(ostream& out) const {
+  uint32_t precision_field = precision;
+  out.write(hll_magic, sizeof(hll_magic));
+  out.write((const char*) &precision_field, sizeof(precision_field));
+  out.write((const char*) registers.data(), registers.size());
+}
+
+HyperLogLog HyperLogLog::load(istream& in) {
+  char magic[sizeof(hll_magic)];
+  uint32_t precision_field;
+  in.read(magic, sizeof(magic));
+  in.read((char*) &precision_field, sizeof(precision_field));
+  if (!in || memcmp(magic, hll_magic, sizeof(magic)) != 0)
+    throw runtime_error("Not a serialized HyperLogLog sketch");
+  if (precision_field < HLL_MIN_PRECISION || precision_field > HLL_MAX_PRECISION)
+    throw runtime_error("Invalid HyperLogLog precision: " + to_string(precision_field));
+
+  HyperLogLog sketch(precision_field);
+  if (!in.read((char*) sketch.registers.data(), sketch.registers.size()))
+    throw runtime_error("Truncated HyperLogLog sketch");
+  return sketch;
+}
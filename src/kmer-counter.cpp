@@ -6,93 +6,284 @@
  */
 
 #include "kmer-counter.hpp"
+#include <sstream>
+#include <stdexcept>
 using namespace std;
 
+// Per-thread buffers that sequences are translated into before counting
+static thread_local vector<uint8_t> translated_codes;
+static thread_local vector<uint64_t> invalid_mask;
+static thread_local uint64_t skipped_bases = 0; // Invalid symbols in the last sequence translated
+
 KmerCounter::KmerCounter(const string& symbols, const unsigned int kmerLength) :
   symbols(symbols), num_symbols((unsigned int) symbols.size()), kmer_length(kmerLength) {
-  kmer_count_vector_size = ipow(kmerLength, num_symbols);
+  compute_sizes();
   populate_map();
+  select_engine();
 }
 
 // Here be performance optimizations
 void KmerCounter::count(const std::string& sequence, long kmerCount[]) {
-  if (kmer_length == 0) return;
-
-  auto sequenceLength = (unsigned int) sequence.length();
-  if (sequenceLength < kmer_length) return;
-
-  auto numSymbols = (unsigned int) symbols.length();
-  if (numSymbols == 0) return;
-
-  // Stores the lexicographic significance of each letter in a kmer
-  auto significances = new unsigned int[kmer_length + 1];
-  for (unsigned int i = 0; i <= kmer_length; i++) significances[i] = ipow(numSymbols, i);
-
-  // index is the lexicographic index in the kmerCount array corresponding
-  // to the k-mer under the sliding window. -1 indicates that there is no index
-  // stored in this variable from the kmer under the previous window
-  int index = -1;
-
-  // Slide a window of size kmer_length along the sequence
-  size_t maximumIndex = sequenceLength - kmer_length;
-  for (size_t i = 0; i <= maximumIndex; i++) {
-    const char* kmer = sequence.c_str() + i; // slide the window
-    index = calculate_index(kmer, significances, index);
-    if (index >= 0) kmerCount[index] += 1; // Valid k-mer encountered
-    // else i -= (index + 1); // Invalid character encountered. Advance window past it.
+  count(sequence.data(), sequence.length(), kmerCount);
+}
+
+void KmerCounter::count(const char* sequence, size_t length, long kmerCount[]) {
+  if (kmer_length == 0 || num_symbols == 0) return;
+
+  const uint8_t* codes = translate(sequence, length);
+  if (partitioned && kmer_count_vector_size >= PARTITION_MIN_VECTOR_SIZE &&
+      kmer_count_vector_size <= PARTITION_MAX_VECTOR_SIZE &&
+      length >= PartitionedCounter::full_block_size(kmer_count_vector_size)) {
+    PartitionedCounter counter(kmerCount, kmer_count_vector_size, length);
+    for_each_valid_run(length, window_length(), [&] (size_t start, size_t end) {
+      for_each_kmer(codes + start, end - start, [&counter] (kmer_code_t index) { counter.add((uint64_t) index); });
+    });
+    return counter.flush();
   }
+
+  const bool use_kernel = kernel != nullptr && !counting_canonical();
+  for_each_valid_run(length, window_length(), [&] (size_t start, size_t end) {
+    if (use_kernel) return kernel(codes + start, end - start, kmerCount);
+    for_each_kmer(codes + start, end - start, [kmerCount] (kmer_code_t index) {
+      kmerCount[(uint64_t) index] += 1;
+    });
+  });
 }
 
-int KmerCounter::calculate_index(const char *kmer, const unsigned int *significances, int index) {
-  if (index < 0) { // Must recalculate
-    index = 0;
-    for (unsigned int j = 0; j < kmer_length; j++) {
-      if (symbol_index_map.find(kmer[j]) == symbol_index_map.end()) return -(j + 1); // invalid next symbol
-      index += symbol_index_map[kmer[j]] * significances[kmer_length - j - 1];
-    }
-  } else { // May use previous window's index to make a quicker calculation
-    if (symbol_index_map.find(kmer[kmer_length - 1]) == symbol_index_map.end()) return -kmer_length;
-    // index = (index * num_symbols) % significances[kmer_length] + symbol_index_map[letter];
-    index = ((index % significances[kmer_length - 1]) * num_symbols) + symbol_index_map[kmer[kmer_length - 1]];
+void KmerCounter::count_range(const std::string& sequence, long* kmerCounts[]) {
+  const unsigned int min_length = get_min_kmer_length();
+  if (kmer_length == 0 || num_symbols == 0) return;
+
+  const uint8_t* codes = translate(sequence);
+  for_each_valid_run(sequence.length(), min_length, [&] (size_t start, size_t end) {
+    for_each_kmer_suffix(codes + start, end - start, [kmerCounts, min_length] (unsigned int k, kmer_code_t index) {
+      kmerCounts[k - min_length][(uint64_t) index] += 1;
+    });
+  });
+}
+
+void KmerCounter::count(const std::string& sequence, SparseKmerCounts& kmerCount) {
+  for_each_kmer(sequence, [&kmerCount] (kmer_code_t index) { kmerCount[index] += 1; });
+}
+
+void KmerCounter::count(const std::string& sequence, ConcurrentKmerTable& kmerCount) {
+  for_each_kmer(sequence, [&kmerCount] (kmer_code_t index) { kmerCount.increment((uint64_t) index); });
+}
+
+void KmerCounter::validate() const {
+  if (num_symbols == 0) throw invalid_argument("No symbols to count k-mers of");
+  if (num_symbols >= SymbolEncoder::invalid) throw invalid_argument("Too many symbols: " + to_string(num_symbols));
+  if (kmer_length == 0) throw invalid_argument("The k-mer length must be positive");
+  if (!index_fits) {
+    stringstream message;
+    message << "k-mers of length " << kmer_length << " over " << num_symbols << " symbols do not fit in a "
+            << 8 * sizeof(kmer_code_t) << "-bit index";
+    throw invalid_argument(message.str());
+  }
+  if (min_kmer_length > kmer_length) {
+    stringstream message;
+    message << "The minimum k-mer length (" << min_kmer_length << ") exceeds the k-mer length (" << kmer_length << ")";
+    throw invalid_argument(message.str());
+  }
+  if (!spaced_seed.empty()) {
+    if (!SpacedSeedEngine::is_valid_seed(spaced_seed))
+      throw invalid_argument("Spaced seeds must be '0's and '1's beginning and ending with '1': " + spaced_seed);
+    if (!index_fits_64) throw invalid_argument("Spaced seed has too many care positions: " + spaced_seed);
+    if (canonical) throw invalid_argument("Canonical counting is not supported with spaced seeds");
+    if (counting_range()) throw invalid_argument("Counting a range of k-mer lengths is not supported with spaced seeds");
+  }
+  if (canonical && !supports_canonical())
+    throw invalid_argument("Canonical counting requires complementary nucleotide symbols: " + symbols);
+}
+
+uint64_t KmerCounter::get_vector_size(unsigned int length) const {
+  if (length == kmer_length) return kmer_count_vector_size;
+  return length < suffix_moduli.size() ? (uint64_t) suffix_moduli[length] : 0;
+}
+
+string KmerCounter::kmer_string(kmer_code_t index) const {
+  string kmer(kmer_length, ' ');
+  for (unsigned int i = kmer_length; i-- > 0;) {
+    kmer[i] = symbols[(size_t) (index % num_symbols)];
+    index /= num_symbols;
+  }
+  return kmer;
+}
+
+kmer_code_t KmerCounter::kmer_index(const string& kmer) const {
+  if (kmer.size() != kmer_length)
+    throw invalid_argument("Expected a k-mer of length " + to_string(kmer_length) + ": " + kmer);
+  kmer_code_t index = 0;
+  for (char symbol : kmer) {
+    uint8_t code = translator.get_encoder().encode(symbol);
+    if (code == SymbolEncoder::invalid) throw invalid_argument("Not a k-mer of " + symbols + ": " + kmer);
+    index = index * num_symbols + code;
   }
   return index;
 }
 
+/**
+ * Private method: translate
+ * -------------------------
+ * Translates a sequence into symbol codes in one vectorized pass (see SequenceTranslator)
+ * @param sequence: The sequence to translate
+ * @param length: Number of symbols in the sequence
+ * @return: Pointer to the codes, which remain valid until this thread's next call
+ */
+const uint8_t* KmerCounter::translate(const char* sequence, size_t length) {
+  translated_codes.resize(length);
+  invalid_mask.resize((length + TRANSLATOR_BLOCK_SIZE - 1) / TRANSLATOR_BLOCK_SIZE);
+  translator.translate(sequence, length, translated_codes.data(), invalid_mask.data());
+
+  skipped_bases = 0;
+  for (uint64_t word : invalid_mask) skipped_bases += __builtin_popcountll(word);
+  return translated_codes.data();
+}
+
+// Bitmask of the invalid positions of the sequence last translated by this thread
+const uint64_t* KmerCounter::translated_invalid_mask() {
+  return invalid_mask.data();
+}
+
+uint64_t KmerCounter::get_skipped_bases() {
+  return skipped_bases;
+}
+
+uint64_t KmerCounter::get_skipped_bases(size_t length) {
+  uint64_t skipped = 0;
+  size_t words = length / TRANSLATOR_BLOCK_SIZE;
+  for (size_t i = 0; i < words; i++) skipped += __builtin_popcountll(invalid_mask[i]);
+  if (length % TRANSLATOR_BLOCK_SIZE != 0) {
+    uint64_t partial = invalid_mask[words] & ((((uint64_t) 1) << (length % TRANSLATOR_BLOCK_SIZE)) - 1);
+    skipped += __builtin_popcountll(partial);
+  }
+  return skipped;
+}
+
 void KmerCounter::set_symbols(const std::string &symbols) {
   this->symbols = symbols;
   num_symbols = (unsigned int) symbols.length();
-  kmer_count_vector_size = ipow(kmer_length, num_symbols);
+  compute_sizes();
   populate_map();
+  select_engine();
 }
 
 void KmerCounter::set_kmer_length(unsigned int kmer_length) {
   this->kmer_length = kmer_length;
-  kmer_count_vector_size = ipow(kmer_length, num_symbols);
+  compute_sizes();
+  select_engine();
+}
+
+void KmerCounter::set_spaced_seed(const string& seed) {
+  spaced_seed = seed;
+  if (SpacedSeedEngine::is_valid_seed(seed)) kmer_length = SpacedSeedEngine::weight_of(seed);
+  compute_sizes();
+  select_engine();
+}
+
+void KmerCounter::set_min_kmer_length(unsigned int min_kmer_length) {
+  this->min_kmer_length = min_kmer_length;
+  compute_sizes();
 }
 
 /**
  * Private method: populate_map
  * ----------------------------
- * Populates the map that maps symbol to lexicographic index. This method should
- * only be called after symbols has been initialized.
+ * Compiles the lookup table that maps symbol to lexicographic index, and the table that maps
+ * each symbol to the index of its complement. This method should only be called after symbols
+ * has been initialized.
  */
 void KmerCounter::populate_map() {
-  symbol_index_map.clear();
+  translator.set_symbols(symbols);
+
+  has_complement = num_symbols > 0;
+  complement_codes.assign(num_symbols, 0);
   for (unsigned int i = 0; i < num_symbols; i++) {
-    symbol_index_map[symbols[i]] = i;
-    symbol_index_map[tolower(symbols[i])] = i;
+    uint8_t code = SymbolEncoder::invalid;
+    for (char complement : complement_of(symbols[i])) {
+      code = translator.get_encoder().encode(complement);
+      if (code != SymbolEncoder::invalid) break;
+    }
+    if (code == SymbolEncoder::invalid) has_complement = false;
+    else complement_codes[i] = code;
+  }
+}
+
+/**
+ * Private method: complement_of
+ * -----------------------------
+ * Gives the bases which pair with a nucleotide, in order of preference
+ * @param symbol: A nucleotide
+ * @return: The complementary bases, or an empty string for symbols which are not nucleotides
+ */
+string KmerCounter::complement_of(char symbol) {
+  switch (toupper(symbol)) {
+    case 'A': return "TU";
+    case 'T': return "A";
+    case 'U': return "A";
+    case 'C': return "G";
+    case 'G': return "C";
+    default: return "";
   }
 }
 
-// Integer exponentiation
-unsigned int KmerCounter::ipow(unsigned int base, unsigned int exp) {
-  if (base == 0 || base == 1) return base;
+/**
+ * Private method: select_engine
+ * -----------------------------
+ * Chooses how future calls to count are carried out. A compile-time specialized kernel is
+ * preferred when one exists for this alphabet size and k-mer length, followed by the shift/mask
+ * engine whenever the number of symbols is a power of two and the k-mer fits in a 64-bit code.
+ * Otherwise the generic path is used. A valid spaced seed overrides all of these.
+ */
+void KmerCounter::select_engine() {
+  use_seed = SpacedSeedEngine::is_valid_seed(spaced_seed) && num_symbols > 0;
+  if (use_seed) seed_engine = SpacedSeedEngine(spaced_seed, num_symbols);
+
+  kernel = use_seed ? nullptr : find_kmer_kernel(num_symbols, kmer_length);
+  use_packed_engine = !use_seed && PackedKmerEngine::supports(num_symbols, kmer_length);
+  if (use_packed_engine) {
+    packed_engine = PackedKmerEngine(num_symbols, kmer_length);
+    packed_engine.set_complement(complement_codes);
+  }
+}
+
+/**
+ * Private method: compute_sizes
+ * -----------------------------
+ * Computes the number of unique k-mers and the significance of the first letter in a k-mer,
+ * noting whether the largest k-mer index fits in a kmer_code_t and whether the number of unique
+ * k-mers fits in 64 bits. Overflow is checked before every multiplication.
+ */
+void KmerCounter::compute_sizes() {
+  const kmer_code_t max_code = ~((kmer_code_t) 0);
 
-  unsigned int result = 1;
-  while (exp) {
-    if (exp & 1) result *= base;
-    exp >>= 1;
-    base *= base;
+  leading_significance = 1;
+  index_fits = num_symbols > 0 && kmer_length > 0;
+  for (unsigned int i = 1; i < kmer_length && index_fits; i++) {
+    if (leading_significance > max_code / num_symbols) index_fits = false;
+    else leading_significance *= num_symbols;
   }
-  return result;
-}
\ No newline at end of file
+
+  // The largest index is (num_symbols - 1) * leading_significance + (leading_significance - 1)
+  if (index_fits)
+    index_fits = num_symbols - 1 <= (max_code - (leading_significance - 1)) / leading_significance;
+
+  index_fits_64 = index_fits &&
+    (leading_significance - 1) + (num_symbols - 1) * leading_significance <= (kmer_code_t) UINT64_MAX;
+  vector_size_fits = index_fits && leading_significance <= UINT64_MAX / num_symbols;
+  kmer_count_vector_size = vector_size_fits ? (uint64_t) leading_significance * num_symbols : 0;
+
+  // Every shorter k-mer has a smaller index than the largest of length kmer_length, so these can't overflow
+  suffix_moduli.clear();
+  if (index_fits) {
+    suffix_moduli.push_back(1);
+    for (unsigned int k = 1; k < kmer_length; k++) suffix_moduli.push_back(suffix_moduli.back() * num_symbols);
+  }
+
+  // Total size of the vectors of every length counted by count_range, saturating on overflow
+  range_vector_size = kmer_count_vector_size;
+  for (unsigned int k = get_min_kmer_length(); vector_size_fits && k < kmer_length; k++) {
+    uint64_t size = (uint64_t) suffix_moduli[k];
+    range_vector_size = range_vector_size > UINT64_MAX - size ? UINT64_MAX : range_vector_size + size;
+  }
+}
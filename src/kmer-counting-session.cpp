@@ -0,0 +1,50 @@
+/**
+ * File: kmer-counting-session.cpp
+ * -------------------------------
+ * Presents the implementation of KmerCountingSession
+ */
+
+#include "kmer-counting-session.hpp"
+#include <cstring>
+using namespace std;
+
+void KmerCountingSession::begin_record(long counts[]) {
+  this->counts = counts;
+  window.clear();
+  carried = 0;
+  skipped_bases = 0;
+}
+
+void KmerCountingSession::feed(const char* fragment, size_t length) {
+  window.resize(carried);
+  append_symbols(window, fragment, length);
+  if (window.size() == carried) return;
+
+  // K-mers lying wholly within the carried symbols were counted with the last fragment
+  kmer_counter.count(window.data(), window.size(), counts);
+  skipped_bases += KmerCounter::get_skipped_bases() - KmerCounter::get_skipped_bases(carried);
+
+  size_t keep = min(window.size(), (size_t) kmer_counter.window_length() - 1);
+  window.erase(0, window.size() - keep);
+  carried = keep;
+}
+
+uint64_t KmerCountingSession::end_record() {
+  counts = nullptr;
+  window.clear();
+  carried = 0;
+  return skipped_bases;
+}
+
+void KmerCountingSession::append_symbols(string& sequence, const char* fragment, size_t length) {
+  const char* end = fragment + length;
+  while (fragment < end) {
+    const char* newline = (const char*) memchr(fragment, '\n', (size_t) (end - fragment));
+    if (newline == nullptr) {
+      sequence.append(fragment, (size_t) (end - fragment));
+      return;
+    }
+    sequence.append(fragment, (size_t) (newline - fragment));
+    fragment = newline + 1;
+  }
+}
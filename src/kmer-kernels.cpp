@@ -0,0 +1,42 @@
+/**
+ * File: kmer-kernels.cpp
+ * ----------------------
+ * Instantiates the specialized k-mer counting kernels and presents the dispatch table
+ * used to select one from runtime values of the alphabet size and k-mer length.
+ */
+
+#include "kmer-kernels.hpp"
+
+#define DNA_NUM_SYMBOLS 4
+#define PROTEIN_NUM_SYMBOLS 20
+
+// Fills table[1..K] with the kernels for an alphabet of NumSymbols symbols
+template<unsigned int NumSymbols, unsigned int K>
+struct KernelTable {
+  static void fill(kmer_kernel_t table[]) {
+    table[K] = &KmerKernel<K, NumSymbols>::count;
+    KernelTable<NumSymbols, K - 1>::fill(table);
+  }
+};
+
+template<unsigned int NumSymbols>
+struct KernelTable<NumSymbols, 0> {
+  static void fill(kmer_kernel_t table[]) { table[0] = nullptr; }
+};
+
+struct KernelDispatchTable {
+  kmer_kernel_t dna[DNA_KERNEL_MAX_K + 1];
+  kmer_kernel_t protein[PROTEIN_KERNEL_MAX_K + 1];
+
+  KernelDispatchTable() {
+    KernelTable<DNA_NUM_SYMBOLS, DNA_KERNEL_MAX_K>::fill(dna);
+    KernelTable<PROTEIN_NUM_SYMBOLS, PROTEIN_KERNEL_MAX_K>::fill(protein);
+  }
+};
+
+kmer_kernel_t find_kmer_kernel(unsigned int num_symbols, unsigned int kmer_length) {
+  static const KernelDispatchTable table;
+  if (num_symbols == DNA_NUM_SYMBOLS && kmer_length <= DNA_KERNEL_MAX_K) return table.dna[kmer_length];
+  if (num_symbols == PROTEIN_NUM_SYMBOLS && kmer_length <= PROTEIN_KERNEL_MAX_K) return table.protein[kmer_length];
+  return nullptr;
+}
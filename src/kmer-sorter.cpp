@@ -0,0 +1,140 @@
+/**
+ * File: kmer-sorter.cpp
+ * ---------------------
+ * Presents the implementation of KmerSorter
+ */
+
+#include "kmer-sorter.hpp"
+#include "parallel-for.hpp"
+#include <algorithm>
+using namespace std;
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define SMALL_SORT_THRESHOLD 64 // Buckets this small are sorted by comparison instead
+#define MIN_BUFFER_CAPACITY 1024
+
+KmerSorter::KmerSorter(boost::threadpool::pool& pool, size_t buffer_size, unsigned int key_bits) :
+  pool(pool), buffer_size(max(buffer_size, (size_t) 1)), key_bits(key_bits) { }
+
+vector<pair<uint64_t, long>> KmerSorter::collect() {
+  flush();
+  return runs;
+}
+
+void KmerSorter::clear() {
+  buffer.clear();
+  runs.clear();
+}
+
+/**
+ * Private method: make_room
+ * -------------------------
+ * Called when the buffer is at capacity. Grows the buffer geometrically, so that sorters of short
+ * sequences stay small, until it reaches buffer_size, after which it is sorted into runs and emptied.
+ */
+void KmerSorter::make_room() {
+  if (buffer.size() >= buffer_size) return flush();
+  buffer.reserve(min(max(2 * buffer.capacity(), (size_t) MIN_BUFFER_CAPACITY), buffer_size));
+}
+
+/**
+ * Private method: flush
+ * ---------------------
+ * Sorts the buffer, collapses it into (code, count) runs, and merges those into the runs so far
+ */
+void KmerSorter::flush() {
+  if (buffer.empty()) return;
+  radix_sort(pool, buffer.data(), buffer.size(), key_bits);
+
+  vector<pair<uint64_t, long>> buffer_runs;
+  for (size_t i = 0; i < buffer.size();) {
+    size_t end = i + 1;
+    while (end < buffer.size() && buffer[end] == buffer[i]) end++;
+    buffer_runs.emplace_back(buffer[i], (long) (end - i));
+    i = end;
+  }
+  buffer.clear();
+
+  if (runs.empty()) runs = move(buffer_runs);
+  else runs = merge_runs(runs, buffer_runs);
+}
+
+vector<pair<uint64_t, long>> KmerSorter::merge_runs(const vector<pair<uint64_t, long>>& a,
+                                                    const vector<pair<uint64_t, long>>& b) {
+  vector<pair<uint64_t, long>> merged;
+  merged.reserve(a.size() + b.size());
+  size_t i = 0, j = 0;
+  while (i < a.size() && j < b.size()) {
+    if (a[i].first < b[j].first) merged.push_back(a[i++]);
+    else if (b[j].first < a[i].first) merged.push_back(b[j++]);
+    else {
+      merged.emplace_back(a[i].first, a[i].second + b[j].second);
+      i++;
+      j++;
+    }
+  }
+  merged.insert(merged.end(), a.begin() + i, a.end());
+  merged.insert(merged.end(), b.begin() + j, b.end());
+  return merged;
+}
+
+// The digit of a code at a shift
+static inline unsigned int digit(uint64_t code, unsigned int shift) {
+  return (unsigned int) (code >> shift) & (RADIX_BUCKETS - 1);
+}
+
+/*
+ * American flag sort: counts the codes with each digit, then permutes codes into their buckets
+ * in place by following cycles, swapping each misplaced code into the next free slot of its bucket.
+ * bounds receives the start of each bucket, and its end as bounds[RADIX_BUCKETS].
+ */
+static void partition(uint64_t codes[], size_t length, unsigned int shift, size_t bounds[]) {
+  size_t counts[RADIX_BUCKETS] = {0};
+  for (size_t i = 0; i < length; i++) counts[digit(codes[i], shift)]++;
+
+  size_t next[RADIX_BUCKETS];
+  bounds[0] = 0;
+  for (unsigned int b = 0; b < RADIX_BUCKETS; b++) {
+    next[b] = bounds[b];
+    bounds[b + 1] = bounds[b] + counts[b];
+  }
+
+  for (unsigned int b = 0; b < RADIX_BUCKETS; b++) {
+    while (next[b] < bounds[b + 1]) {
+      uint64_t code = codes[next[b]];
+      for (unsigned int d = digit(code, shift); d != b; d = digit(code, shift)) swap(code, codes[next[d]++]);
+      codes[next[b]++] = code;
+    }
+  }
+}
+
+// The shift of the digit below the one at shift. Digits may overlap, which is harmless since the
+// overlapping bits are equal throughout a bucket.
+static inline unsigned int next_shift(unsigned int shift) {
+  return shift > RADIX_BITS ? shift - RADIX_BITS : 0;
+}
+
+// Sorts codes whose digits above shift + RADIX_BITS are all equal
+static void sort_digits(uint64_t codes[], size_t length, unsigned int shift) {
+  if (length <= SMALL_SORT_THRESHOLD) return sort(codes, codes + length);
+
+  size_t bounds[RADIX_BUCKETS + 1];
+  partition(codes, length, shift, bounds);
+  if (shift == 0) return;
+  for (unsigned int b = 0; b < RADIX_BUCKETS; b++)
+    sort_digits(codes + bounds[b], bounds[b + 1] - bounds[b], next_shift(shift));
+}
+
+void KmerSorter::radix_sort(boost::threadpool::pool& pool, uint64_t codes[], size_t length, unsigned int key_bits) {
+  if (length <= SMALL_SORT_THRESHOLD) return sort(codes, codes + length);
+
+  unsigned int shift = next_shift(max(key_bits, (unsigned int) RADIX_BITS));
+  size_t bounds[RADIX_BUCKETS + 1];
+  partition(codes, length, shift, bounds);
+  if (shift == 0) return;
+
+  parallel_for(pool, RADIX_BUCKETS, [codes, &bounds, shift] (size_t b) {
+    sort_digits(codes + bounds[b], bounds[b + 1] - bounds[b], next_shift(shift));
+  });
+}
@@ -7,6 +7,7 @@
 #include "local-kmer-counter.hpp"
 
 #include <boost/program_options.hpp>
+#include <stdexcept>
 #include <boost/filesystem.hpp>
 
 #include <boost/log/expressions.hpp>
@@ -18,6 +19,7 @@
 
 #define NUM_THREADS 8
 #define K_DEFAULT 4
+#define MEMORY_BUDGET_DEFAULT 4096
 #define DNA_SYMBOLS "ATGC"
 
 namespace po = boost::program_options;
@@ -37,25 +39,84 @@ LocalKmerCounter::LocalKmerCounter(int argc, const char* argv[]) : pool(NUM_THRE
   setup_streams();
 
   counter.set_kmer_length(kmer_length);
+  counter.set_min_kmer_length(min_kmer_length);
   counter.set_symbols(symbols);
+  counter.set_spaced_seed(spaced_seed);
   counter.set_sum_files(sum_files);
+  counter.set_canonical(canonical);
+  counter.set_partitioned(partitioned);
+  counter.set_sorting(sorting);
+  counter.set_disk_buckets(disk_buckets);
+  counter.set_temp_directory(temp_directory);
+  counter.set_sketch(sketch, sketch_width, sketch_depth);
+  if (cardinality) counter.set_cardinality(hll_precision);
+  counter.set_bloom_filter(((size_t) bloom_filter) << 20, bloom_exact);
+  counter.set_spectrum(spectrum);
+  counter.set_top_kmers(top_kmers, space_saving);
+  counter.set_memory_budget(((uint64_t) memory_budget) << 20);
+  counter.set_counter_bits(counter_bits);
+  counter.set_report_skipped(report_skipped);
+
+  try {
+    counter.validate();
+  } catch (const invalid_argument& e) {
+    BOOST_LOG_SEV(log, logging::trivial::error) << e.what();
+    exit(1);
+  }
 
   BOOST_LOG_SEV(log, logging::trivial::info) << "Source: " << (from_stdin ? "standard input" : input_source);
   BOOST_LOG_SEV(log, logging::trivial::info) << "Output: " << (to_stdout ? "standard output" : output_file);
   BOOST_LOG_SEV(log, logging::trivial::info) << "k-mer length: " << kmer_length;
+  if (!spaced_seed.empty())
+    BOOST_LOG_SEV(log, logging::trivial::info) << "Spaced seed: " << spaced_seed;
+  if (min_kmer_length != 0)
+    BOOST_LOG_SEV(log, logging::trivial::info) << "Minimum k-mer length: " << min_kmer_length;
   BOOST_LOG_SEV(log, logging::trivial::info) << "Symbols: " << symbols;
   BOOST_LOG_SEV(log, logging::trivial::info) << "File regex: " << file_regex;
   BOOST_LOG_SEV(log, logging::trivial::info) << "Sequential processing " << (sequential ? "enabled" : "disabled");
+  BOOST_LOG_SEV(log, logging::trivial::info) << "Dense count vector budget: " << memory_budget << " MiB";
+  BOOST_LOG_SEV(log, logging::trivial::info) << "Counter width: " << counter_bits << " bits";
+  BOOST_LOG_SEV(log, logging::trivial::info) << "Canonical counting " << (canonical ? "enabled" : "disabled");
+  BOOST_LOG_SEV(log, logging::trivial::info) << "Partitioned counting " << (partitioned ? "enabled" : "disabled");
+  BOOST_LOG_SEV(log, logging::trivial::info) << "Sort-based counting " << (sorting ? "enabled" : "disabled");
+  if (disk_buckets > 0)
+    BOOST_LOG_SEV(log, logging::trivial::info) << "Out-of-core counting in " << disk_buckets << " bucket files";
+  BOOST_LOG_SEV(log, logging::trivial::info) << "Spectrum output " << (spectrum ? "enabled" : "disabled");
+  if (top_kmers > 0)
+    BOOST_LOG_SEV(log, logging::trivial::info) << "Most frequent k-mers: " << top_kmers
+                                               << (space_saving > 0 ? " (Space-Saving, " + to_string(space_saving) + " counters)" : "");
+  if (bloom_filter > 0)
+    BOOST_LOG_SEV(log, logging::trivial::info) << "Bloom filter: " << bloom_filter << " MiB"
+                                               << (bloom_exact ? ", exact second pass" : "");
+  if (cardinality)
+    BOOST_LOG_SEV(log, logging::trivial::info) << "Cardinality estimation with HyperLogLog precision " << hll_precision;
+  if (!sketch.empty())
+    BOOST_LOG_SEV(log, logging::trivial::info) << "Count-Min sketch (" << sketch << "): " << sketch_depth << " rows of "
+                                               << sketch_width << " counters";
 }
 
 void LocalKmerCounter::run() {
   BOOST_LOG_SEV(log, logging::trivial::info) << "Processing: " << (from_stdin ? "standard input" : input_source) << "...";
-  if (from_stdin) counter.count(cin, *out_stream_p, sequential);
-  else {
-    if (directory_count) counter.count_directory(input_source, *out_stream_p, sequential);
-    else counter.count_fasta_file(input_source, *out_stream_p, sequential);
+  try {
+    if (from_stdin) counter.count(cin, *out_stream_p, sequential);
+    else {
+      if (directory_count) counter.count_directory(input_source, *out_stream_p, sequential);
+      else counter.count_fasta_file(input_source, *out_stream_p, sequential);
+    }
+  } catch (const runtime_error& e) {
+    BOOST_LOG_SEV(log, logging::trivial::error) << e.what();
+    exit(1);
   }
   BOOST_LOG_SEV(log, logging::trivial::info) << "Processing complete.";
+
+  if (cardinality) {
+    HyperLogLog all_kmers = counter.cardinality_sketch();
+    BOOST_LOG_SEV(log, logging::trivial::info) << "Distinct k-mers over all input: " << all_kmers.estimate();
+    if (!hll_output.empty()) {
+      ofstream sketch_out(hll_output, ios::binary);
+      all_kmers.save(sketch_out);
+    }
+  }
 }
 
 /**
@@ -83,6 +144,16 @@ void LocalKmerCounter::setup_streams() {
     }
   }
 
+  if (bloom_exact && from_stdin) {
+    BOOST_LOG_SEV(log, logging::trivial::error) << "The exact second pass can't re-read standard input";
+    exit(1);
+  }
+
+  if (disk_buckets > 0 && !temp_directory.empty() && !fs::is_directory(temp_directory)) {
+    BOOST_LOG_SEV(log, logging::trivial::error) << "Not a directory: " << temp_directory;
+    exit(1);
+  }
+
   // Make the output stream
   if (to_stdout) out_stream_p = &cout;
   else out_stream_p = new ofstream(output_file);
@@ -143,8 +214,29 @@ void LocalKmerCounter::parse_CLI_options(int argc, const char* argv[]) {
   config.add_options()
           ("regex,r",   po::value<string>(&fre)->default_value(".*"),      "file pattern regular expression")
           ("k,k",       po::value<size_t>(&kmer_length)->default_value(K_DEFAULT), "k-mer size (i.e. \"k\")")
+          ("seed",      po::value<string>(&spaced_seed)->default_value(""), "spaced seed such as 1101011 selecting the symbols of each k-mer")
+          ("min-k",     po::value<size_t>(&min_kmer_length)->default_value(0), "also count every k-mer size from min-k up to k")
           ("symbols,s", po::value<string>(&symbols)->default_value(DNA_SYMBOLS), "symbols to use for counting")
           ("sum,sum",   po::bool_switch(&sum_files), "sum all k-mer counts per file")
+          ("canonical", po::bool_switch(&canonical), "count k-mers together with their reverse complements")
+          ("sort",      po::bool_switch(&sorting), "count k-mers by radix sorting their codes, output as \"k-mer:count\"")
+          ("disk-buckets", po::value<size_t>(&disk_buckets)->default_value(0), "count out of core in this many minimizer bucket files (with --sum)")
+          ("tmp-dir",   po::value<string>(&temp_directory)->default_value(""), "directory for bucket files (default: system temporary directory)")
+          ("sketch",    po::value<string>(&sketch)->default_value(""), "count approximately into a Count-Min sketch (countmin or conservative)")
+          ("sketch-width", po::value<size_t>(&sketch_width)->default_value(DEFAULT_SKETCH_WIDTH), "counters in each row of the sketch")
+          ("sketch-depth", po::value<unsigned int>(&sketch_depth)->default_value(DEFAULT_SKETCH_DEPTH), "rows (hash functions) in the sketch")
+          ("cardinality", po::bool_switch(&cardinality), "only estimate the number of distinct k-mers, with HyperLogLog")
+          ("hll-precision", po::value<unsigned int>(&hll_precision)->default_value(DEFAULT_HLL_PRECISION), "HyperLogLog register bits (4 to 18)")
+          ("hll-output", po::value<string>(&hll_output)->default_value(""), "file to write the HyperLogLog sketch of every k-mer counted to")
+          ("bloom-filter", po::value<size_t>(&bloom_filter)->default_value(0), "keep k-mers seen once out of the sparse table with a Bloom filter this size (MiB, with --sum)")
+          ("bloom-exact", po::bool_switch(&bloom_exact), "recount k-mers passing the Bloom filter exactly in a second pass")
+          ("spectrum",  po::bool_switch(&spectrum), "output the k-mer spectrum (\"count:k-mers\" pairs) instead of the counts")
+          ("top",       po::value<size_t>(&top_kmers)->default_value(0), "output only the N most frequent k-mers, as \"k-mer:count\"")
+          ("space-saving", po::value<size_t>(&space_saving)->default_value(0), "find the --top k-mers by streaming through this many Space-Saving counters")
+          ("partition", po::bool_switch(&partitioned), "radix-partition k-mers into cache-sized buckets before counting")
+          ("report-skipped", po::bool_switch(&report_skipped), "append the number of invalid bases in each record to its header")
+          ("memory,m",  po::value<size_t>(&memory_budget)->default_value(MEMORY_BUDGET_DEFAULT), "largest dense count vector (MiB)")
+          ("counter-bits", po::value<unsigned int>(&counter_bits)->default_value(64), "bits per dense k-mer counter (8, 16, 32 or 64)")
           ("sequential,sequential", po::bool_switch(&sequential), "sequential processing");
 
   po::options_description hidden("Hidden");
@@ -16,12 +16,94 @@
  *  -k=4
  *    The size of the kmers to count
  *
+ *  --seed=1101011
+ *    Counts gapped k-mers made of the symbols under the '1' positions of a
+ *    spaced seed as it slides along each sequence. Overrides -k with the
+ *    number of '1's, and counts are laid out as for contiguous k-mers of
+ *    that length
+ *
+ *  --min-k=1
+ *    Counts every k-mer size from min-k up to k in a single pass over the input.
+ *    Each record is output as a block of lines, one per k-mer size, with
+ *    " k=<size>" appended to the header
+ *
  *  --symbols=ATGC
  *    The symbols to use to count kmers
  *
  *  --sum-fasta
  *    Will sum all of the k-mer counts from a single file into one k-mer count
  *
+ *  --memory=4096
+ *    The largest dense count vector to allocate per record, in MiB. Beyond this
+ *    (e.g. for k=21..31) counts are written sparsely as "k-mer:count" pairs. With
+ *    --sum, all records in a file are counted into one lock-free table shared by
+ *    every thread
+ *
+ *  --counter-bits=64
+ *    The width of each counter in a dense count vector (8, 16, 32 or 64). Narrow
+ *    counters saturate and spill into a side table, so counts remain exact
+ *
+ *  --canonical
+ *    Counts each k-mer together with its reverse complement, and outputs only the
+ *    counts of canonical k-mers (those no greater than their reverse complement)
+ *
+ *  --sort
+ *    Counts k-mers by collecting their codes into buffers no larger than the
+ *    memory budget and radix sorting them on the thread pool, rather than with
+ *    dense vectors or hash tables. Memory use is predictable and counts are
+ *    written sparsely as "k-mer:count" pairs in lexicographic order, as with
+ *    large k. Requires k-mer codes that fit in 64 bits
+ *
+ *  --spectrum
+ *    Outputs the k-mer spectrum of each record (or file, with --sum) in place
+ *    of its counts: the header followed by "count:k-mers" pairs giving how
+ *    many k-mers occur once, twice, and so on, e.g. "> id1, 1:120, 2:31, 5:2"
+ *
+ *  --top=100 --space-saving=10000
+ *    Outputs only the 100 most frequent k-mers of each record (or file, with
+ *    --sum), as "k-mer:count" pairs in decreasing order of count, selected
+ *    from the counts in parallel. With --space-saving, k-mers aren't counted
+ *    exactly: they are streamed through this many Space-Saving counters, in
+ *    bounded memory, and the counts given may overestimate
+ *
+ *  --bloom-filter=256 --bloom-exact
+ *    Keeps k-mers which occur only once (mostly sequencing errors) out of the
+ *    sparse count table with a Bloom filter of this many MiB. Requires --sum;
+ *    only k-mers seen at least twice are output, as "k-mer:count" pairs. Counts
+ *    may be one too high for false positives of the filter unless
+ *    --bloom-exact recounts them in a second pass over the input
+ *
+ *  --cardinality --hll-precision=14 --hll-output=all.hll
+ *    Only estimates the number of distinct k-mers in each record (or file,
+ *    with --sum) with a HyperLogLog sketch of 2^precision bytes, whose
+ *    relative error is about 1.04/sqrt(2^precision). Each line of output is
+ *    "header, <distinct k-mers>". The merged sketch of all input is written to
+ *    --hll-output in the format described in hyperloglog.hpp
+ *
+ *  --sketch=countmin --sketch-width=4194304 --sketch-depth=4
+ *    Counts k-mers approximately in a fixed-size Count-Min sketch of
+ *    depth rows of width 32-bit counters, whatever the size of the input.
+ *    Estimates exceed true counts by at most e/width of the total count
+ *    with probability 1 - e^-depth. --sketch=conservative uses conservative
+ *    update, which overestimates less. One sketch is written per file in the
+ *    serialized format described in count-min-sketch.hpp
+ *
+ *  --disk-buckets=64 --tmp-dir=/scratch
+ *    Counts data sets larger than memory. Each record is split into
+ *    super-k-mers by minimizer and spilled to one of this many bucket files
+ *    in --tmp-dir, then each bucket is counted in memory on the thread pool.
+ *    Requires --sum; the counts of each file are written sparsely as
+ *    "k-mer:count" pairs in lexicographic order
+ *
+ *  --partition
+ *    Radix-partitions the k-mers of each block of a record into cache-sized
+ *    buckets before counting them, so that counting large dense vectors (e.g.
+ *    k=14) stays within cache instead of accessing memory at random
+ *
+ *  --report-skipped
+ *    Appends " skipped=<bases>" to the header of each record, the number of
+ *    invalid symbols (e.g. N) in the record which were stepped over
+ *
  */
 
 #include "local-kmer-counter.hpp"
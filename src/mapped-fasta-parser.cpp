@@ -0,0 +1,105 @@
+/**
+ * File: mapped-fasta-parser.cpp
+ * -----------------------------
+ * Presents the implementation of MappedFastaParser
+ */
+
+#include "mapped-fasta-parser.hpp"
+#include "fasta-block-reader.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+using namespace std;
+
+string FastaRecordView::sequence_string() const {
+  string symbols;
+  symbols.reserve(sequence_length);
+  SequenceCursor cursor(*this);
+  for (const char* line; size_t length = cursor.next(line);) symbols.append(line, length);
+  return symbols;
+}
+
+MappedFastaParser::MappedFastaParser(const string& fasta_file) {
+  int fd = open(fasta_file.c_str(), O_RDONLY);
+  if (fd < 0) throw runtime_error("Could not open " + fasta_file);
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw runtime_error("Could not stat " + fasta_file);
+  }
+  size = (size_t) info.st_size;
+  if (size > 0) {
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      close(fd);
+      throw runtime_error("Could not map " + fasta_file);
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    data = (const char*) mapping;
+  }
+  close(fd); // The mapping keeps the file open
+}
+
+MappedFastaParser::~MappedFastaParser() {
+  if (data != nullptr) munmap((void*) data, size);
+}
+
+bool MappedFastaParser::is_mappable(const string& fasta_file) {
+  struct stat info;
+  return stat(fasta_file.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+}
+
+bool MappedFastaParser::next(FastaRecordView& record) {
+  if (!parse(record, position, size)) return false;
+  record.range = 0;
+  record.index = num_parsed++;
+  return true;
+}
+
+MappedFastaParser::Range::Range(const MappedFastaParser& parser, size_t range, size_t num_ranges) :
+  parser(parser), range(range) {
+  position = (size_t) ((uint64_t) parser.size * range / num_ranges);
+  end = (size_t) ((uint64_t) parser.size * (range + 1) / num_ranges);
+}
+
+bool MappedFastaParser::Range::next(FastaRecordView& record) {
+  if (!parser.parse(record, position, end)) return false;
+  record.range = range;
+  record.index = index++;
+  return true;
+}
+
+/**
+ * Private method: parse
+ * ---------------------
+ * Parses the record whose header is the first at or after a position, if that header begins before the
+ * end of a range. The position need not be at the start of a line.
+ * @param record: Set to the record
+ * @param position: Where to look for the header from. Set to the end of the record.
+ * @param end: End of the range
+ * @return: True if there was a record whose header begins in the range
+ */
+bool MappedFastaParser::parse(FastaRecordView& record, size_t& position, size_t end) const {
+  // Anything before the next header is skipped
+  if (position < size && (data[position] != '>' || (position > 0 && data[position - 1] != '\n')))
+    position = FastaBlockReader::find_header(data, position, size);
+  if (position >= end || position >= size) return false;
+
+  const char* newline = (const char*) memchr(data + position, '\n', size - position);
+  size_t header_end = newline == nullptr ? size : (size_t) (newline - data);
+  record.header = data + position;
+  record.header_length = header_end - position;
+
+  // The sequence runs up to the next header
+  size_t start = min(header_end + 1, size);
+  size_t sequence_end = start < size && data[start] == '>' ? start : FastaBlockReader::find_header(data, start, size);
+  record.sequence = data + start;
+  record.sequence_length = sequence_end - start;
+  position = sequence_end;
+  return true;
+}
@@ -0,0 +1,160 @@
+/**
+ * File: sequence-translator.cpp
+ * -----------------------------
+ * Presents the implementation of SequenceTranslator, including the vectorized translation
+ * kernels and their selection at program start up.
+ */
+
+#include "sequence-translator.hpp"
+#include <cctype>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define HAS_X86_TRANSLATION_KERNELS
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Translates num_blocks whole blocks of TRANSLATOR_BLOCK_SIZE bytes
+typedef void (*translate_kernel_t)(const SequenceTranslator::Table& table, const char* sequence, size_t num_blocks,
+                                   uint8_t codes[], uint64_t invalid_mask[]);
+
+#ifdef HAS_X86_TRANSLATION_KERNELS
+
+__attribute__((target("sse4.2")))
+static void translate_sse42(const SequenceTranslator::Table& table, const char* sequence, size_t num_blocks,
+                            uint8_t codes[], uint64_t invalid_mask[]) {
+  const __m128i fold = _mm_set1_epi8(table.fold_case ? 0x20 : 0);
+  const __m128i invalid = _mm_set1_epi8((char) SymbolEncoder::invalid);
+  for (size_t b = 0; b < num_blocks; b++) {
+    uint64_t mask = 0;
+    for (int lane = 0; lane < 4; lane++) {
+      size_t offset = b * TRANSLATOR_BLOCK_SIZE + lane * 16;
+      __m128i bytes = _mm_or_si128(_mm_loadu_si128((const __m128i*) (sequence + offset)), fold);
+      __m128i out = invalid;
+      for (unsigned int p = 0; p < table.num_pairs; p++) {
+        __m128i match = _mm_cmpeq_epi8(bytes, _mm_set1_epi8((char) table.bytes[p]));
+        out = _mm_blendv_epi8(out, _mm_set1_epi8((char) table.codes[p]), match);
+      }
+      _mm_storeu_si128((__m128i*) (codes + offset), out);
+      mask |= ((uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(out, invalid))) << (lane * 16);
+    }
+    invalid_mask[b] = mask;
+  }
+}
+
+__attribute__((target("avx2")))
+static void translate_avx2(const SequenceTranslator::Table& table, const char* sequence, size_t num_blocks,
+                           uint8_t codes[], uint64_t invalid_mask[]) {
+  const __m256i fold = _mm256_set1_epi8(table.fold_case ? 0x20 : 0);
+  const __m256i invalid = _mm256_set1_epi8((char) SymbolEncoder::invalid);
+  for (size_t b = 0; b < num_blocks; b++) {
+    uint64_t mask = 0;
+    for (int lane = 0; lane < 2; lane++) {
+      size_t offset = b * TRANSLATOR_BLOCK_SIZE + lane * 32;
+      __m256i bytes = _mm256_or_si256(_mm256_loadu_si256((const __m256i*) (sequence + offset)), fold);
+      __m256i out = invalid;
+      for (unsigned int p = 0; p < table.num_pairs; p++) {
+        __m256i match = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8((char) table.bytes[p]));
+        out = _mm256_blendv_epi8(out, _mm256_set1_epi8((char) table.codes[p]), match);
+      }
+      _mm256_storeu_si256((__m256i*) (codes + offset), out);
+      mask |= ((uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(out, invalid))) << (lane * 32);
+    }
+    invalid_mask[b] = mask;
+  }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void translate_avx512(const SequenceTranslator::Table& table, const char* sequence, size_t num_blocks,
+                             uint8_t codes[], uint64_t invalid_mask[]) {
+  const __m512i fold = _mm512_set1_epi8(table.fold_case ? 0x20 : 0);
+  const __m512i invalid = _mm512_set1_epi8((char) SymbolEncoder::invalid);
+  for (size_t b = 0; b < num_blocks; b++) {
+    size_t offset = b * TRANSLATOR_BLOCK_SIZE;
+    __m512i bytes = _mm512_or_si512(_mm512_loadu_si512((const void*) (sequence + offset)), fold);
+    __m512i out = invalid;
+    __mmask64 valid = 0;
+    for (unsigned int p = 0; p < table.num_pairs; p++) {
+      __mmask64 match = _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8((char) table.bytes[p]));
+      out = _mm512_mask_blend_epi8(match, out, _mm512_set1_epi8((char) table.codes[p]));
+      valid |= match;
+    }
+    _mm512_storeu_si512((void*) (codes + offset), out);
+    invalid_mask[b] = ~((uint64_t) valid);
+  }
+}
+
+#endif
+
+/**
+ * Function: select_kernel
+ * -----------------------
+ * Chooses the widest translation kernel that this processor supports
+ * @param name: Set to the name of the chosen instruction set
+ * @return: The kernel, or nullptr if only scalar translation is available
+ */
+static translate_kernel_t select_kernel(const char*& name) {
+#ifdef HAS_X86_TRANSLATION_KERNELS
+  __builtin_cpu_init(); // Required since this runs before main
+  if (__builtin_cpu_supports("avx512bw")) { name = "AVX-512BW"; return translate_avx512; }
+  if (__builtin_cpu_supports("avx2")) { name = "AVX2"; return translate_avx2; }
+  if (__builtin_cpu_supports("sse4.2")) { name = "SSE4.2"; return translate_sse42; }
+#endif
+  name = "scalar";
+  return nullptr;
+}
+
+static const char* kernel_name = nullptr;
+static const translate_kernel_t kernel = select_kernel(kernel_name);
+
+const char* SequenceTranslator::instruction_set() {
+  return kernel_name;
+}
+
+/*
+ * The vector kernels compare every block against each (byte, code) pair. If every
+ * symbol is an upper case letter, then each symbol and its lower case form can share a
+ * pair by setting the 0x20 bit of each byte before comparing. Otherwise there is a pair for
+ * every recognized byte. Alphabets needing more than TRANSLATOR_MAX_PAIRS pairs are translated
+ * with the scalar encoder.
+ */
+void SequenceTranslator::set_symbols(const string &symbols) {
+  encoder.set_symbols(symbols);
+
+  table.fold_case = !symbols.empty();
+  for (char symbol : symbols)
+    if (!isupper((unsigned char) symbol)) table.fold_case = false;
+
+  table.num_pairs = 0;
+  table.vectorizable = true;
+  for (int byte = 0; byte < 256; byte++) {
+    uint8_t code = encoder.encode((char) byte);
+    if (code == SymbolEncoder::invalid) continue;
+    if (table.fold_case && !islower(byte)) continue;
+    if (table.num_pairs == TRANSLATOR_MAX_PAIRS) {
+      table.vectorizable = false;
+      break;
+    }
+    table.bytes[table.num_pairs] = (uint8_t) byte;
+    table.codes[table.num_pairs] = code;
+    table.num_pairs++;
+  }
+}
+
+void SequenceTranslator::translate(const char* sequence, size_t length, uint8_t codes[], uint64_t invalid_mask[]) const {
+  size_t translated = 0;
+  if (kernel != nullptr && table.vectorizable) {
+    size_t num_blocks = length / TRANSLATOR_BLOCK_SIZE;
+    kernel(table, sequence, num_blocks, codes, invalid_mask);
+    translated = num_blocks * TRANSLATOR_BLOCK_SIZE;
+  }
+
+  // Scalar translation of whatever the kernel did not cover
+  for (size_t i = translated; i < length; i++) {
+    if (i % TRANSLATOR_BLOCK_SIZE == 0) invalid_mask[i / TRANSLATOR_BLOCK_SIZE] = 0;
+    codes[i] = encoder.encode(sequence[i]);
+    if (codes[i] == SymbolEncoder::invalid)
+      invalid_mask[i / TRANSLATOR_BLOCK_SIZE] |= ((uint64_t) 1) << (i % TRANSLATOR_BLOCK_SIZE);
+  }
+}
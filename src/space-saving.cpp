@@ -0,0 +1,104 @@
+/**
+ * File: space-saving.cpp
+ * ----------------------
+ * Presents the implementation of SpaceSaving
+ */
+
+#include "space-saving.hpp"
+#include <algorithm>
+using namespace std;
+
+SpaceSaving::SpaceSaving(size_t capacity) : capacity(max(capacity, (size_t) 1)) {
+  heap.reserve(this->capacity);
+  positions.reserve(this->capacity);
+}
+
+void SpaceSaving::add(uint64_t code) {
+  auto found = positions.find(code);
+  if (found != positions.end()) {
+    heap[found->second].count++;
+    sift_down(found->second);
+    return;
+  }
+
+  if (heap.size() < capacity) {
+    positions[code] = heap.size();
+    heap.push_back({code, 1, 0});
+    sift_up(heap.size() - 1);
+    return;
+  }
+
+  // Take over the counter with the least count
+  Counter& least = heap.front();
+  positions.erase(least.code);
+  least = {code, least.count + 1, least.count};
+  positions[code] = 0;
+  sift_down(0);
+}
+
+void SpaceSaving::merge(const SpaceSaving& other) {
+  long this_min = min_count(), other_min = other.min_count();
+
+  unordered_map<uint64_t, Counter> merged;
+  for (const Counter& counter : heap) merged[counter.code] = {counter.code, counter.count + other_min, counter.error + other_min};
+  for (const Counter& counter : other.heap) {
+    auto found = merged.find(counter.code);
+    if (found == merged.end()) {
+      merged[counter.code] = {counter.code, counter.count + this_min, counter.error + this_min};
+    } else {
+      found->second.count += counter.count - other_min;
+      found->second.error += counter.error - other_min;
+    }
+  }
+
+  vector<Counter> counters;
+  counters.reserve(merged.size());
+  for (auto& entry : merged) counters.push_back(entry.second);
+  if (counters.size() > capacity) {
+    nth_element(counters.begin(), counters.begin() + capacity, counters.end(),
+                [] (const Counter& a, const Counter& b) { return a.count > b.count; });
+    counters.resize(capacity);
+  }
+
+  heap = move(counters);
+  positions.clear();
+  for (size_t i = 0; i < heap.size(); i++) positions[heap[i].code] = i;
+  for (size_t i = heap.size() / 2; i-- > 0;) sift_down(i);
+}
+
+vector<pair<uint64_t, long>> SpaceSaving::top(size_t n) const {
+  vector<pair<uint64_t, long>> kmers;
+  kmers.reserve(heap.size());
+  for (const Counter& counter : heap) kmers.emplace_back(counter.code, counter.count);
+  n = min(n, kmers.size());
+  partial_sort(kmers.begin(), kmers.begin() + n, kmers.end(), [] (const pair<uint64_t, long>& a, const pair<uint64_t, long>& b) {
+    return a.second > b.second || (a.second == b.second && a.first < b.first);
+  });
+  kmers.resize(n);
+  return kmers;
+}
+
+void SpaceSaving::sift_up(size_t i) {
+  while (i > 0 && heap[(i - 1) / 2].count > heap[i].count) {
+    swap_counters(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+void SpaceSaving::sift_down(size_t i) {
+  while (true) {
+    size_t least = i;
+    size_t left = 2 * i + 1, right = 2 * i + 2;
+    if (left < heap.size() && heap[left].count < heap[least].count) least = left;
+    if (right < heap.size() && heap[right].count < heap[least].count) least = right;
+    if (least == i) return;
+    swap_counters(i, least);
+    i = least;
+  }
+}
+
+void SpaceSaving::swap_counters(size_t i, size_t j) {
+  swap(heap[i], heap[j]);
+  positions[heap[i].code] = i;
+  positions[heap[j].code] = j;
+}
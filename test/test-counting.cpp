@@ -0,0 +1,648 @@
+/*
+ * File: test-counting.cpp
+ * -----------------------
+ * Checks that each way of counting k-mers gives the same counts as the plain sequential path (or, for
+ * approximate counting, counts within the bounds it promises). Each test is run by name from ctest.
+ *
+ * Usage:
+ *
+ *  ./test-counting chunked-seed
+ */
+
+#include "async-kmer-counter.hpp"
+#include "count-min-sketch.hpp"
+#include "kmer-sorter.hpp"
+#include "mapped-fasta-parser.hpp"
+#include <boost/filesystem.hpp>
+#include <threadpool.hpp>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+#define NUM_THREADS 4
+#define DNA_SYMBOLS "ATGC"
+
+// Fails the test being run
+#define CHECK(condition) \
+  if (!(condition)) throw runtime_error(string(__FILE__) + ":" + to_string(__LINE__) + ": " #condition)
+
+typedef function<void(AsyncKmerCounter&)> Configure;
+
+// A random sequence of DNA, the same on every run, with a run of invalid symbols every so often
+static string random_sequence(size_t length, unsigned int seed) {
+  mt19937 random(seed);
+  string sequence(length, 'A');
+  for (size_t i = 0; i < length; i++) sequence[i] = DNA_SYMBOLS[random() % 4];
+  for (size_t i = random() % 100000; i + 10 < length; i += 100000 + random() % 100000)
+    sequence.replace(i, 1 + random() % 10, 1 + random() % 10, 'N');
+  return sequence;
+}
+
+// FASTA text of (header, sequence) records, with sequences wrapped at 80 symbols per line
+static string fasta(const vector<pair<string, string>>& records) {
+  string text;
+  for (auto& record : records) {
+    text += ">" + record.first + "\n";
+    for (size_t i = 0; i < record.second.size(); i += 80) text += record.second.substr(i, 80) + "\n";
+  }
+  return text;
+}
+
+// Splits output into its lines, sorted, since asynchronous counting outputs records in any order
+static vector<string> sorted_lines(const string& output) {
+  vector<string> lines;
+  istringstream in(output);
+  for (string line; getline(in, line);) lines.push_back(line);
+  sort(lines.begin(), lines.end());
+  return lines;
+}
+
+// Output from counting FASTA text with a counter set up by configure
+static string count_output(const string& text, bool sequential, const Configure& configure) {
+  boost::threadpool::pool pool(NUM_THREADS);
+  AsyncKmerCounter counter(pool, DNA_SYMBOLS, 4);
+  configure(counter);
+  counter.validate();
+
+  istringstream in(text);
+  ostringstream out;
+  counter.count(in, out, sequential);
+  return out.str();
+}
+
+// Lines of output from counting FASTA text with a counter set up by configure
+static vector<string> count_lines(const string& text, bool sequential, const Configure& configure) {
+  return sorted_lines(count_output(text, sequential, configure));
+}
+
+// A file holding some text, removed when the test is done with it
+struct TemporaryFile {
+  const string path;
+  explicit TemporaryFile(const string& text) :
+    path((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string()) {
+    ofstream(path, ios::binary) << text;
+  }
+  ~TemporaryFile() { boost::filesystem::remove(path); }
+};
+
+// Lines of output from counting a FASTA file, mapped into memory if it counts records alone
+static vector<string> count_file_lines(const string& path, bool sequential, const Configure& configure) {
+  boost::threadpool::pool pool(NUM_THREADS);
+  AsyncKmerCounter counter(pool, DNA_SYMBOLS, 4);
+  configure(counter);
+  counter.validate();
+
+  ostringstream out;
+  counter.count_fasta_file(path, out, sequential);
+  return sorted_lines(out.str());
+}
+
+// Exact count of every k-mer in every record
+static SparseKmerCounts exact_counts(const vector<pair<string, string>>& records, unsigned int kmer_length) {
+  KmerCounter kmer_counter(DNA_SYMBOLS, kmer_length);
+  SparseKmerCounts counts;
+  for (auto& record : records) kmer_counter.count(record.second, counts);
+  return counts;
+}
+
+// Checks that counting asynchronously gives the same output as counting sequentially
+static void check_same_as_sequential(const string& text, const Configure& configure) {
+  auto expected = count_lines(text, true, configure);
+  CHECK(!expected.empty());
+  CHECK(count_lines(text, false, configure) == expected);
+}
+
+// The "k-mer:count" pairs of a line of sparse output
+static map<string, long> sparse_counts(const string& line) {
+  map<string, long> counts;
+  for (size_t start = line.find(", "); start != string::npos;) {
+    size_t end = line.find(", ", start + 2);
+    string pair = line.substr(start + 2, end == string::npos ? string::npos : end - start - 2);
+    counts[pair.substr(0, pair.find(':'))] = stol(pair.substr(pair.find(':') + 1));
+    start = end;
+  }
+  return counts;
+}
+
+/*
+ * A record long enough to be split into chunks counted on several threads, with gapped k-mers whose
+ * seed spans more symbols than it selects. Every k-mer crossing a chunk boundary must still be counted,
+ * so the counts must match both sequential counting and counting each window by brute force.
+ */
+static void test_chunked_seed() {
+  const string seed = "1101011";
+  const string sequence = random_sequence(5 * PARALLEL_RECORD_THRESHOLD / 4, 14);
+  const string text = fasta({{"chromosome", sequence}});
+  auto configure = [&seed] (AsyncKmerCounter& counter) { counter.set_spaced_seed(seed); };
+  check_same_as_sequential(text, configure);
+
+  vector<long> counts(1 << 10);
+  for (size_t i = 0; i + seed.size() <= sequence.size(); i++) {
+    size_t index = 0;
+    bool valid = true;
+    for (size_t j = 0; j < seed.size(); j++) {
+      size_t symbol = string(DNA_SYMBOLS).find(sequence[i + j]);
+      valid = valid && symbol != string::npos; // Even under a '0', as for every window of valid symbols
+      if (seed[j] == '1') index = index * 4 + symbol;
+    }
+    if (valid) counts[index]++;
+  }
+  string expected = ">chromosome";
+  for (long count : counts) expected += ", " + to_string(count);
+  CHECK(count_lines(text, false, configure) == vector<string>{expected});
+}
+
+/*
+ * Records long enough to be split into chunks counted on several threads at once, among short ones
+ * which are not, with the number of invalid symbols skipped reported in each header. Chunked counting
+ * must give the same counts as counting each record whole.
+ */
+static void test_chunked() {
+  vector<pair<string, string>> records;
+  for (size_t i = 0; i < 6; i++) {
+    size_t length = i % 2 ? 1000 + 997 * i : PARALLEL_RECORD_THRESHOLD + PARALLEL_CHUNK_SIZE * i / 2 + 11;
+    records.emplace_back("record" + to_string(i), random_sequence(length, 20 + i));
+  }
+  const string text = fasta(records);
+
+  vector<Configure> modes = {
+    [] (AsyncKmerCounter&) { },
+    [] (AsyncKmerCounter& counter) { counter.set_canonical(true); },
+    [] (AsyncKmerCounter& counter) { counter.set_kmer_length(10); },
+  };
+  for (auto& mode : modes) {
+    check_same_as_sequential(text, [&mode] (AsyncKmerCounter& counter) {
+      counter.set_kmer_length(8);
+      counter.set_report_skipped(true);
+      mode(counter);
+    });
+  }
+}
+
+/*
+ * K-mers added to a table again and again while it grows from a small first generation, by several
+ * threads at once. Their counts must survive being moved from generation to generation, and every
+ * outgrown generation must be retired once growth has finished, leaving only the newest to search.
+ */
+static void test_table_growth() {
+  const size_t num_kmers = 1 << 20;
+  const long num_rounds = 3;
+  ConcurrentKmerTable table(1 << 10);
+  {
+    boost::threadpool::pool pool(NUM_THREADS);
+    for (long round = 0; round < num_rounds; round++) {
+      for (size_t thread = 0; thread < NUM_THREADS; thread++) {
+        pool.schedule([&table, thread] () {
+          for (uint64_t code = thread; code < num_kmers; code += NUM_THREADS) table.increment(code * 2654435761u);
+        });
+      }
+      pool.wait();
+    }
+  }
+
+  auto kmers = table.collect();
+  CHECK(kmers.size() == num_kmers);
+  for (auto& kmer : kmers) CHECK(kmer.second == num_rounds);
+  CHECK(table.generations() == 1);
+  CHECK(table.capacity() < 3 * num_kmers); // One generation, up to 70% full
+}
+
+// K-mers too long for a dense vector, summed over a file into one table shared by every thread
+static void test_sparse_sum() {
+  vector<pair<string, string>> records;
+  const string genome = random_sequence(1 << 20, 7);
+  for (size_t i = 0; i < 16; i++) records.emplace_back("read" + to_string(i), genome.substr(i << 15, 1 << 18));
+  check_same_as_sequential(fasta(records), [] (AsyncKmerCounter& counter) {
+    counter.set_kmer_length(21);
+    counter.set_sum_files(true);
+  });
+}
+
+/*
+ * K-mers summed over a file when their codes need more than 64 bits (in a KMER_WIDE_INDEX build, or
+ * else codes that fit), so that they are counted into maps rather than a shared table. The one line of
+ * output must hold the sums of the counts of each record.
+ */
+static void test_wide_sum() {
+  const unsigned int kmer_length = sizeof(kmer_code_t) > sizeof(uint64_t) ? 33 : 21;
+  vector<pair<string, string>> records;
+  const string genome = random_sequence(1 << 18, 13);
+  for (size_t i = 0; i < 8; i++) records.emplace_back("read" + to_string(i), genome.substr(i << 14, 1 << 15));
+  const string text = fasta(records);
+
+  map<string, long> expected;
+  for (auto& line : count_lines(text, true, [kmer_length] (AsyncKmerCounter& counter) { counter.set_kmer_length(kmer_length); }))
+    for (auto& kmer : sparse_counts(line)) expected[kmer.first] += kmer.second;
+
+  auto configure = [kmer_length] (AsyncKmerCounter& counter) {
+    counter.set_kmer_length(kmer_length);
+    counter.set_sum_files(true);
+  };
+  for (bool sequential : {true, false}) {
+    auto lines = count_lines(text, sequential, configure);
+    CHECK(lines.size() == 1);
+    CHECK(lines[0].compare(0, 7, ">read0,") == 0);
+    CHECK(sparse_counts(lines[0]) == expected);
+  }
+}
+
+// K-mers too long for a dense vector, counted per record in tables capped by a small memory budget
+static void test_sparse_records() {
+  vector<pair<string, string>> records;
+  const string genome = random_sequence(1 << 18, 8);
+  for (size_t i = 0; i < 8; i++) records.emplace_back("read" + to_string(i), genome.substr(i << 13, 1 << 16));
+  const string text = fasta(records);
+  auto configure = [] (AsyncKmerCounter& counter) {
+    counter.set_kmer_length(21);
+    counter.set_memory_budget(1 << 14);
+  };
+  check_same_as_sequential(text, configure);
+  CHECK(count_lines(text, false, configure) == count_lines(text, true, [] (AsyncKmerCounter& counter) {
+    counter.set_kmer_length(21);
+    counter.set_sorting(true);
+  }));
+}
+
+/*
+ * Counting by sorting, with a memory budget small enough that each record fills the sorter's buffer
+ * several times over, must give the same counts as counting in a table, per record and summed. So must
+ * the sorter itself, sorting codes into runs and merging them, against a map.
+ */
+static void test_sorting() {
+  vector<pair<string, string>> records;
+  const string genome = random_sequence(1 << 18, 11);
+  for (size_t i = 0; i < 8; i++) records.emplace_back("read" + to_string(i), genome.substr(i << 13, 1 << 16));
+  const string text = fasta(records);
+
+  for (unsigned int kmer_length : {21, 31}) {
+    for (bool sum_files : {false, true}) {
+      auto in_table = [kmer_length, sum_files] (AsyncKmerCounter& counter) {
+        counter.set_kmer_length(kmer_length);
+        counter.set_sum_files(sum_files);
+      };
+      auto sorted = [&in_table] (AsyncKmerCounter& counter) {
+        in_table(counter);
+        counter.set_sorting(true);
+        counter.set_memory_budget(1 << 16);
+      };
+      auto expected = count_lines(text, true, in_table);
+      CHECK(!expected.empty());
+      CHECK(count_lines(text, true, sorted) == expected);
+      CHECK(count_lines(text, false, sorted) == expected);
+    }
+  }
+
+  boost::threadpool::pool pool(NUM_THREADS);
+  KmerSorter sorter(pool, 1000, 42);
+  map<uint64_t, long> expected;
+  mt19937_64 random(12);
+  for (size_t i = 0; i < 100000; i++) {
+    uint64_t code = (random() & ((1ull << 42) - 1)) >> (i % 3 ? 30 : 0); // Many codes repeat
+    sorter.add(code);
+    expected[code]++;
+  }
+  vector<pair<uint64_t, long>> runs(expected.begin(), expected.end());
+  CHECK(sorter.collect() == runs);
+}
+
+/*
+ * A Count-Min sketch of every k-mer of a file, far narrower than the number of distinct k-mers. Its
+ * estimates must never fall below the true counts, and may exceed them by more than e / width of the
+ * total for at most a fraction e^-depth of k-mers. Conservative update keeps to the same bounds with
+ * estimates no greater than the plain sketch's. Adding to the plain sketch on several threads gives
+ * the same counters as adding sequentially.
+ */
+static void test_count_min() {
+  const unsigned int kmer_length = 12;
+  const size_t width = 1 << 12;
+  const unsigned int depth = 4;
+  vector<pair<string, string>> records;
+  for (size_t i = 0; i < 8; i++) records.emplace_back("read" + to_string(i), random_sequence(1 << 17, 30 + i));
+  const string text = fasta(records);
+  const SparseKmerCounts expected = exact_counts(records, kmer_length);
+
+  map<string, unique_ptr<CountMinSketch>> sketches;
+  for (string sketch : {"countmin", "conservative"}) {
+    auto configure = [&sketch, width, depth] (AsyncKmerCounter& counter) {
+      counter.set_kmer_length(kmer_length);
+      counter.set_sketch(sketch, width, depth);
+    };
+    istringstream in(count_output(text, false, configure));
+    sketches[sketch] = CountMinSketch::load(in);
+    if (sketch == "countmin") CHECK(count_output(text, true, configure) == in.str());
+  }
+
+  uint64_t total = 0;
+  for (auto& kmer : expected) total += (uint64_t) kmer.second;
+  const double bound = exp(1.0) * (double) total / width;
+  for (auto& sketch : sketches) {
+    CHECK(sketch.second->get_total() == total);
+    size_t num_over = 0;
+    for (auto& kmer : expected) {
+      uint32_t estimate = sketch.second->estimate((uint64_t) kmer.first);
+      CHECK(estimate >= kmer.second);
+      CHECK(estimate <= sketches["countmin"]->estimate((uint64_t) kmer.first));
+      if (estimate > kmer.second + bound) num_over++;
+    }
+    CHECK(num_over <= exp(-(double) depth) * expected.size());
+  }
+}
+
+/*
+ * HyperLogLog estimates of the number of distinct k-mers of records from small to large, and of every
+ * k-mer counted, must be within four standard errors (1.04 / sqrt(registers)) of the exact number.
+ * Sketches take the maximum of each register, so counting on several threads gives the same estimates.
+ */
+static void test_hyperloglog() {
+  const unsigned int kmer_length = 21;
+  const unsigned int precision = 12;
+  vector<pair<string, string>> records;
+  for (size_t i = 0; i < 6; i++) records.emplace_back("record" + to_string(i), random_sequence(1000 << (2 * i), 40 + i));
+  auto configure = [] (AsyncKmerCounter& counter) {
+    counter.set_kmer_length(kmer_length);
+    counter.set_cardinality(precision);
+  };
+  const string text = fasta(records);
+  check_same_as_sequential(text, configure);
+
+  const double error = 4 * 1.04 / sqrt((double) (1 << precision));
+  auto lines = count_lines(text, false, configure);
+  CHECK(lines.size() == records.size());
+  for (size_t i = 0; i < records.size(); i++) {
+    double distinct = (double) exact_counts({records[i]}, kmer_length).size();
+    double estimate = stod(lines[i].substr(lines[i].find(", ") + 2));
+    CHECK(lines[i].compare(0, records[i].first.size() + 3, ">" + records[i].first + ", ") == 0);
+    CHECK(fabs(estimate - distinct) <= error * distinct);
+  }
+
+  boost::threadpool::pool pool(NUM_THREADS);
+  AsyncKmerCounter counter(pool, DNA_SYMBOLS, kmer_length);
+  configure(counter);
+  istringstream in(text);
+  ostringstream out;
+  counter.count(in, out, false);
+  double distinct = (double) exact_counts(records, kmer_length).size();
+  CHECK(fabs((double) counter.cardinality_sketch().estimate() - distinct) <= error * distinct);
+}
+
+/*
+ * Overlapping reads counted with a Bloom filter small enough to give false positives. Every k-mer
+ * occurring at least twice must be output, with its true count or one more, and nothing occurring once
+ * unless a false positive put it in the table. With the exact second pass, the output must be the true
+ * counts of the k-mers occurring at least twice.
+ */
+static void test_bloom_filter() {
+  const unsigned int kmer_length = 21;
+  vector<pair<string, string>> records;
+  const string genome = random_sequence(1 << 18, 50);
+  for (size_t i = 0; i < 16; i++) records.emplace_back("read" + to_string(i), genome.substr(i << 14, 1 << 15));
+  const string text = fasta(records);
+
+  KmerCounter kmer_counter(DNA_SYMBOLS, kmer_length);
+  map<string, long> expected, repeated;
+  for (auto& kmer : exact_counts(records, kmer_length)) {
+    expected[kmer_counter.kmer_string(kmer.first)] = kmer.second;
+    if (kmer.second >= 2) repeated[kmer_counter.kmer_string(kmer.first)] = kmer.second;
+  }
+
+  for (bool sequential : {true, false}) {
+    for (bool exact : {false, true}) {
+      auto lines = count_lines(text, sequential, [exact] (AsyncKmerCounter& counter) {
+        counter.set_kmer_length(kmer_length);
+        counter.set_sum_files(true);
+        counter.set_bloom_filter(1 << 16, exact);
+      });
+      CHECK(lines.size() == 1);
+      auto counts = sparse_counts(lines[0]);
+      if (exact) {
+        CHECK(counts == repeated);
+        continue;
+      }
+      size_t num_over = 0;
+      for (auto& kmer : repeated) CHECK(counts.count(kmer.first) == 1);
+      for (auto& kmer : counts) {
+        long count = expected.at(kmer.first);
+        CHECK(kmer.second >= 2 && (kmer.second == count || kmer.second == count + 1));
+        if (kmer.second > count) num_over++;
+      }
+      CHECK(num_over > 0); // Or the filter is too big for the test to mean anything
+    }
+  }
+}
+
+/*
+ * A FASTA file with text before its first header, blank lines, an empty record, a '>' within a header,
+ * a record long enough to be streamed and no newline at the end. Mapping it must give the same records
+ * as reading it through a stream, and counting it mapped the same counts as counting the stream.
+ */
+static void test_mapped() {
+  vector<pair<string, string>> records;
+  for (size_t i = 0; i < 20; i++) records.emplace_back("record" + to_string(i), random_sequence(i == 7 ? 300000 : 100 * i + 50, 60 + i));
+  const string text = "not a header\n" + fasta(records) + ">empty\n>header>with>marks\nACGT\n\nNNACGTACGT\n\nACG";
+  TemporaryFile file(text);
+
+  MappedFastaParser mapped(file.path);
+  istringstream in(text);
+  FastaParser parser(&in);
+  FastaRecordView record;
+  size_t num_records = 0;
+  for (auto it = parser.begin(); it != parser.end(); ++it, num_records++) {
+    CHECK(mapped.next(record));
+    CHECK(record.index == num_records);
+    CHECK(record.header_string() == it->first);
+    CHECK(record.sequence_string() == it->second);
+  }
+  CHECK(!mapped.next(record));
+  CHECK(num_records == records.size() + 2);
+
+  vector<Configure> modes = {
+    [] (AsyncKmerCounter&) { },
+    [] (AsyncKmerCounter& counter) { counter.set_kmer_length(21); },
+    [] (AsyncKmerCounter& counter) { counter.set_counter_bits(16); },
+    [] (AsyncKmerCounter& counter) { counter.set_sum_files(true); },
+  };
+  for (auto& mode : modes) {
+    auto configure = [&mode] (AsyncKmerCounter& counter) {
+      counter.set_kmer_length(8);
+      mode(counter);
+    };
+    auto expected = count_lines(text, true, configure);
+    CHECK(!expected.empty());
+    CHECK(count_file_lines(file.path, true, configure) == expected);
+    CHECK(count_file_lines(file.path, false, configure) == expected);
+  }
+}
+
+/*
+ * A file split into byte ranges, from one up to more ranges than it has records. Every record must be
+ * parsed by exactly one range, in order within the range, so that together the ranges give the records
+ * of the file in order. A file large enough to be parsed on several threads must be counted the same.
+ */
+static void test_byte_ranges() {
+  vector<pair<string, string>> records;
+  mt19937 random(70);
+  for (size_t i = 0; i < 2000; i++)
+    records.emplace_back(i % 7 ? "read" + to_string(i) : "read>" + to_string(i), random_sequence(1000 + random() % 3000, 70 + i));
+  const string text = fasta(records);
+  TemporaryFile file(text);
+
+  MappedFastaParser parser(file.path);
+  vector<string> expected;
+  FastaRecordView record;
+  while (parser.next(record)) expected.push_back(record.header_string() + "\n" + record.sequence_string());
+  CHECK(expected.size() == records.size());
+  for (size_t num_ranges : {1, 2, 3, 4, 7, 16, 100, 1999, 2000, 5000}) {
+    vector<string> parsed;
+    for (size_t i = 0; i < num_ranges; i++) {
+      MappedFastaParser::Range range(parser, i, num_ranges);
+      for (size_t index = 0; range.next(record); index++) {
+        CHECK(record.range == i && record.index == index);
+        parsed.push_back(record.header_string() + "\n" + record.sequence_string());
+      }
+    }
+    CHECK(parsed == expected);
+  }
+
+  CHECK(text.size() >= NUM_THREADS * PARSE_RANGE_MIN_SIZE);
+  vector<Configure> modes = {
+    [] (AsyncKmerCounter&) { },
+    [] (AsyncKmerCounter& counter) {
+      counter.set_kmer_length(12);
+      counter.set_top_kmers(3, 0);
+    },
+  };
+  for (auto& mode : modes) {
+    auto expected_lines = count_lines(text, true, mode);
+    CHECK(expected_lines.size() == records.size());
+    CHECK(count_file_lines(file.path, false, mode) == expected_lines);
+  }
+}
+
+/*
+ * The spectrum and the most frequent k-mers, which are found on the thread pool before each line is
+ * written, from short records, dense vectors, narrow counters, sparse tables and ranges of lengths
+ */
+static void test_summaries() {
+  vector<pair<string, string>> records;
+  for (size_t i = 0; i < 12; i++) records.emplace_back("record" + to_string(i), random_sequence(i % 2 ? 1000 : 200000, i));
+  const string text = fasta(records);
+
+  vector<Configure> modes = {
+    [] (AsyncKmerCounter&) { },
+    [] (AsyncKmerCounter& counter) { counter.set_counter_bits(16); },
+    [] (AsyncKmerCounter& counter) { counter.set_kmer_length(21); },
+    [] (AsyncKmerCounter& counter) { counter.set_min_kmer_length(3); },
+    [] (AsyncKmerCounter& counter) { counter.set_sum_files(true); },
+  };
+  for (auto& mode : modes) {
+    check_same_as_sequential(text, [&mode] (AsyncKmerCounter& counter) {
+      counter.set_kmer_length(8);
+      mode(counter);
+      counter.set_spectrum(true);
+    });
+    check_same_as_sequential(text, [&mode] (AsyncKmerCounter& counter) {
+      counter.set_kmer_length(8);
+      mode(counter);
+      counter.set_top_kmers(5, 0);
+    });
+  }
+}
+
+/*
+ * Out-of-core counting, with super-k-mers spilled to bucket files and the counts of every bucket merged
+ * back together, must give the same line as summing the counts in memory. Including the spectrum and the
+ * most frequent k-mers, which are found from the merged counts.
+ */
+static void test_disk_buckets() {
+  vector<pair<string, string>> records;
+  const string genome = random_sequence(1 << 19, 9);
+  for (size_t i = 0; i < 8; i++) records.emplace_back("read" + to_string(i), genome.substr(i << 15, 1 << 16));
+  const string text = fasta(records);
+
+  vector<Configure> modes = {
+    [] (AsyncKmerCounter&) { },
+    [] (AsyncKmerCounter& counter) { counter.set_spectrum(true); },
+    [] (AsyncKmerCounter& counter) { counter.set_top_kmers(5, 0); },
+  };
+  for (auto& mode : modes) {
+    auto in_memory = [&mode] (AsyncKmerCounter& counter) {
+      counter.set_kmer_length(21);
+      counter.set_sum_files(true);
+      mode(counter);
+    };
+    auto on_disk = [&in_memory] (AsyncKmerCounter& counter) {
+      in_memory(counter);
+      counter.set_disk_buckets(8);
+    };
+    auto expected = count_lines(text, true, in_memory);
+    CHECK(!expected.empty());
+    CHECK(count_lines(text, true, on_disk) == expected);
+    CHECK(count_lines(text, false, on_disk) == expected);
+  }
+}
+
+// Bucket files that can't be created must be reported, rather than giving no counts at all
+static void test_disk_buckets_error() {
+  const string text = fasta({{"read", random_sequence(1 << 12, 10)}});
+  for (bool sequential : {true, false}) {
+    bool thrown = false;
+    try {
+      count_lines(text, sequential, [] (AsyncKmerCounter& counter) {
+        counter.set_kmer_length(21);
+        counter.set_sum_files(true);
+        counter.set_disk_buckets(8);
+        counter.set_temp_directory("/proc"); // No directory may be created here
+      });
+    } catch (const runtime_error&) {
+      thrown = true;
+    }
+    CHECK(thrown);
+  }
+}
+
+static const map<string, function<void()>> tests = {
+  {"chunked", test_chunked},
+  {"chunked-seed", test_chunked_seed},
+  {"table-growth", test_table_growth},
+  {"sparse-sum", test_sparse_sum},
+  {"wide-sum", test_wide_sum},
+  {"sparse-records", test_sparse_records},
+  {"sorting", test_sorting},
+  {"summaries", test_summaries},
+  {"disk-buckets", test_disk_buckets},
+  {"count-min", test_count_min},
+  {"hyperloglog", test_hyperloglog},
+  {"bloom-filter", test_bloom_filter},
+  {"mapped", test_mapped},
+  {"byte-ranges", test_byte_ranges},
+  {"disk-buckets-error", test_disk_buckets_error},
+};
+
+int main(int argc, char* argv[]) {
+  vector<string> names;
+  for (int i = 1; i < argc; i++) names.push_back(argv[i]);
+  if (names.empty()) for (auto& test : tests) names.push_back(test.first);
+
+  int failures = 0;
+  for (auto& name : names) {
+    auto test = tests.find(name);
+    try {
+      if (test == tests.end()) throw runtime_error("No such test");
+      test->second();
+      cout << "Passed: " << name << endl;
+    } catch (const exception& e) {
+      cerr << "Failed: " << name << ": " << e.what() << endl;
+      failures++;
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}